@@ -114,6 +114,7 @@ struct Ivar : public std::enable_shared_from_this<Ivar<T>> {
   void fill(Args&&... args)
   {
     _set_value(std::forward<Args>(args)...);
+    _notify_observers();
     _maybe_schedule();
   }
 
@@ -124,6 +125,17 @@ struct Ivar : public std::enable_shared_from_this<Ivar<T>> {
     _maybe_schedule();
   }
 
+  // Unlike the listener there can be any number of observers, they are only
+  // told that the ivar is determined and leave the value to the listener
+  void notify_when_determined(std::function<void()> observer)
+  {
+    if (_is_determined) {
+      schedule(std::move(observer));
+    } else {
+      _observers.push_back(std::move(observer));
+    }
+  }
+
   static Deferred<T> value(const ptr& ivar) { return Deferred<T>(ivar); }
 
   lvalue_type value() &
@@ -150,6 +162,13 @@ struct Ivar : public std::enable_shared_from_this<Ivar<T>> {
     _is_determined = true;
   }
 
+  void _notify_observers()
+  {
+    auto observers = std::move(_observers);
+    _observers.clear();
+    for (auto& observer : observers) { schedule(std::move(observer)); }
+  }
+
   void _maybe_schedule()
   {
     if (_listener && _value.has_value() && !_dead) {
@@ -169,6 +188,7 @@ struct Ivar : public std::enable_shared_from_this<Ivar<T>> {
   }
 
   listener_t _listener;
+  std::vector<std::function<void()>> _observers;
   std::optional<bee::unit_if_void_t<T>> _value;
   bool _dead = false;
   bool _is_determined = false;
@@ -301,6 +321,11 @@ template <deferable_value T = void> struct DeferredImpl {
     _ivar->on_determined(std::forward<F>(callback));
   }
 
+  void notify_when_determined(std::function<void()> observer)
+  {
+    _ivar->notify_when_determined(std::move(observer));
+  }
+
   lvalue_type value() & { return _ivar->value(); }
   rvalue_type value() && { return std::move(*_ivar).value(); }
   const_lvalue_type value() const& { return _ivar->value(); }
@@ -401,6 +426,13 @@ template <deferable_value T = void> struct Deferred {
 
   bool is_determined() const { return _d->is_determined(); }
 
+  // Calls observer once determined without taking the value, see
+  // Ivar::notify_when_determined
+  void notify_when_determined(std::function<void()> observer) const
+  {
+    _d->notify_when_determined(std::move(observer));
+  }
+
   const typename DeferredImpl<T>::ptr& impl() const { return _d; }
 
  private:
@@ -1,5 +1,23 @@
 #include "async_fd.hpp"
 
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef __APPLE__
+#include <linux/errqueue.h>
+#endif
+
+#ifndef __APPLE__
+#include <sys/sendfile.h>
+#endif
+
 #include "async.hpp"
 #include "deferred_awaitable.hpp"
 
@@ -11,6 +29,56 @@ using std::weak_ptr;
 
 namespace async {
 
+namespace {
+
+constexpr int max_iovecs = std::min(IOV_MAX, 256);
+
+#ifdef __APPLE__
+constexpr size_t send_file_chunk = 64 * 1024;
+#endif
+
+#ifdef MSG_NOSIGNAL
+constexpr int send_flags = MSG_NOSIGNAL;
+#else
+constexpr int send_flags = 0;
+#endif
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0
+#endif
+
+// Fills iov with up to length bytes of buffer starting at skip, returns the
+// number of iovecs used
+int gather_iovecs(
+  const bee::DataBuffer& buffer, size_t skip, size_t length, iovec* iov)
+{
+  int count = 0;
+  for (const auto& block : buffer) {
+    if (length == 0 || count == max_iovecs) { break; }
+    if (block.size() <= skip) {
+      skip -= block.size();
+      continue;
+    }
+    size_t size = std::min(block.size() - skip, length);
+    iov[count].iov_base = const_cast<std::byte*>(block.data()) + skip;
+    iov[count].iov_len = size;
+    length -= size;
+    skip = 0;
+    count++;
+  }
+  return count;
+}
+
+void fill_waiters(
+  IvarMulti<bee::OrError<>>::ptr& ivar, const bee::OrError<>& value)
+{
+  if (ivar == nullptr) { return; }
+  ivar->fill(value);
+  ivar = nullptr;
+}
+
+} // namespace
+
 AsyncFD::AsyncFD(const FD::shared_ptr& fd, bool is_socket)
     : _fd(fd), _is_socket(is_socket)
 {}
@@ -35,11 +103,15 @@ void AsyncFD::_handle_ready()
 {
   if (_fd == nullptr) { assert(false && "Got data after close"); }
 
+  if (!_zerocopy_in_flight.empty()) {
+    _reap_zerocopy_completions(*_fd, _zerocopy_in_flight);
+  }
+
   // TODO: handle error better
   must_unit(_maybe_write());
 
   if (_ready_callback != nullptr) { _ready_callback(); }
-  if (_wait_ready != nullptr) { _wait_ready->fill(); }
+  _wake_waiters();
 }
 
 void AsyncFD::set_ready_callback(ready_callback&& ready_callback)
@@ -49,20 +121,55 @@ void AsyncFD::set_ready_callback(ready_callback&& ready_callback)
 
 bee::OrError<> AsyncFD::write(const string& data)
 {
-  _outgoing.write(data);
-  return _maybe_write();
+  bee::DataBuffer buffer;
+  buffer.write(data);
+  return _enqueue(std::move(buffer));
 }
 
 bee::OrError<> AsyncFD::write(string&& data)
 {
-  _outgoing.write(std::move(data));
-  return _maybe_write();
+  bee::DataBuffer buffer;
+  buffer.write(std::move(data));
+  return _enqueue(std::move(buffer));
 }
 
 bee::OrError<> AsyncFD::write(bee::DataBuffer&& data)
 {
-  _outgoing.write(std::move(data));
-  return _maybe_write();
+  return _enqueue(std::move(data));
+}
+
+bee::OrError<> AsyncFD::write(const SharedBuffer& data)
+{
+  return _enqueue_shared(data);
+}
+
+bee::OrError<> AsyncFD::_enqueue(bee::DataBuffer&& data)
+{
+  if (_sending_file) { shot("Cannot write while send_file is running"); }
+  if (_zerocopy_threshold > 0 && data.size() >= _zerocopy_threshold) {
+    return _enqueue_shared(SharedBuffer(std::move(data)));
+  }
+  if (!data.empty()) {
+    _outgoing_bytes += data.size();
+    if (_outgoing.empty() || !_outgoing.back().shared.empty()) {
+      _outgoing.emplace_back();
+    }
+    _outgoing.back().plain.write(std::move(data));
+  }
+  return _after_enqueue();
+}
+
+bee::OrError<> AsyncFD::_enqueue_shared(const SharedBuffer& data)
+{
+  if (_sending_file) { shot("Cannot write while send_file is running"); }
+  if (!data.empty()) {
+    _outgoing_bytes += data.size();
+    auto& entry = _outgoing.emplace_back();
+    entry.shared = data;
+    entry.zerocopy =
+      _zerocopy_threshold > 0 && data.size() >= _zerocopy_threshold;
+  }
+  return _after_enqueue();
 }
 
 bee::OrError<bee::ReadResult> AsyncFD::read(bee::DataBuffer& buf)
@@ -70,31 +177,149 @@ bee::OrError<bee::ReadResult> AsyncFD::read(bee::DataBuffer& buf)
   return _read(buf);
 }
 
+bee::OrError<optional<size_t>> AsyncFD::read_some(
+  std::byte* data, size_t size)
+{
+  if (_fd == nullptr) { shot("FD already closed"); }
+  ssize_t ret;
+  do {
+    if (_is_socket) {
+      ret = ::recv(_fd->int_fd(), data, size, 0);
+    } else {
+      ret = ::read(_fd->int_fd(), data, size);
+    }
+  } while (ret == -1 && errno == EINTR);
+  if (ret == -1) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) { return nullopt; }
+    shot("Failed to read: $", strerror(errno));
+  }
+  return optional<size_t>(ret);
+}
+
+bee::OrError<optional<PooledBuffer>> AsyncFD::read_pooled(size_t max_bytes)
+{
+  bail(buffer, receive_buffer_pool()->acquire());
+  bail(
+    bytes_read,
+    read_some(buffer.data(), std::min(buffer.capacity(), max_bytes)));
+  if (!bytes_read.has_value()) { return nullopt; }
+  buffer.set_size(*bytes_read);
+  return optional<PooledBuffer>(std::move(buffer));
+}
+
+void AsyncFD::set_auto_cork(bool enabled) { _auto_cork = enabled; }
+
+bee::OrError<> AsyncFD::_after_enqueue()
+{
+  if (_write_error.has_value()) { return *_write_error; }
+  if (!_auto_cork) { return _maybe_write(); }
+  if (_fd == nullptr) { shot("FD already closed"); }
+  if (!_flush_scheduled) {
+    _flush_scheduled = true;
+    before_wait([weak = weak_from_this()]() {
+      if (auto ptr = weak.lock()) { ptr->_flush_corked(); }
+    });
+  }
+  return bee::ok();
+}
+
+// There is no caller to return errors to, so they are reported by the next
+// write(), flushed() and writable()
+void AsyncFD::_flush_corked()
+{
+  _flush_scheduled = false;
+  if (_fd == nullptr) { return; }
+  auto result = _maybe_write();
+  if (result.is_error()) {
+    _write_error = std::move(result.error());
+    fill_waiters(_flushed_ivar, *_write_error);
+    fill_waiters(_writable_ivar, *_write_error);
+  }
+}
+
 bee::OrError<> AsyncFD::_maybe_write()
 {
-  size_t bytes_sent = 0;
-  for (auto& block : _outgoing) {
-    if (block.empty()) { continue; }
-    size_t block_bytes_sent = 0;
-    while (block_bytes_sent < block.size()) {
-      bail(
-        ret,
-        _write(
-          block.data() + block_bytes_sent, block.size() - block_bytes_sent));
-      if (ret == 0) { break; }
-      block_bytes_sent += ret;
+  while (!_outgoing.empty()) {
+    auto& entry = _outgoing.front();
+    bail(bytes_sent, _write_outgoing(entry));
+    if (bytes_sent == 0) { break; }
+    _outgoing_bytes -= bytes_sent;
+    bool done;
+    if (!entry.shared.empty()) {
+      entry.shared_sent += bytes_sent;
+      done = entry.shared_sent == entry.shared.size();
+    } else {
+      entry.plain.consume(bytes_sent);
+      done = entry.plain.empty();
     }
-    bytes_sent += block_bytes_sent;
-    if (block_bytes_sent < block.size()) { break; }
+    if (done) { _outgoing.pop_front(); }
+  }
+  if (_outgoing_bytes == 0 && _zerocopy_in_flight.empty()) {
+    fill_waiters(_flushed_ivar, bee::ok());
   }
-  _outgoing.consume(bytes_sent);
-  if (_outgoing.empty() && _flushed_ivar != nullptr) {
-    _flushed_ivar->fill(bee::ok());
-    _flushed_ivar = nullptr;
+  if (_outgoing_bytes <= _low_watermark) {
+    fill_waiters(_writable_ivar, bee::ok());
   }
   return bee::ok();
 }
 
+bee::OrError<size_t> AsyncFD::_write_outgoing(OutgoingEntry& entry)
+{
+  if (_fd == nullptr) { shot("FD already closed"); }
+
+  bool zerocopy = entry.zerocopy;
+  iovec iov[max_iovecs];
+  int count;
+  if (!entry.shared.empty()) {
+    count = gather_iovecs(
+      *entry.shared.storage(),
+      entry.shared.offset() + entry.shared_sent,
+      entry.shared.size() - entry.shared_sent,
+      iov);
+  } else {
+    count = gather_iovecs(entry.plain, 0, entry.plain.size(), iov);
+  }
+  if (count == 0) { return 0; }
+
+  // bee::FD only tracks whether the fd is write blocked, which SchedulerPoll
+  // relies on, for writes that go through it. Single blocks without zero copy
+  // and the first write after being blocked go through it to keep that flag
+  // up to date.
+  auto write_first = [&]() {
+    return _write(
+      static_cast<const std::byte*>(iov[0].iov_base), iov[0].iov_len);
+  };
+  if ((count == 1 && !zerocopy) || _fd->is_write_blocked()) {
+    return write_first();
+  }
+
+  int flags = send_flags | (zerocopy ? MSG_ZEROCOPY : 0);
+  ssize_t ret;
+  while (true) {
+    if (_is_socket) {
+      msghdr msg{};
+      msg.msg_iov = iov;
+      msg.msg_iovlen = count;
+      ret = ::sendmsg(_fd->int_fd(), &msg, flags);
+    } else {
+      ret = ::writev(_fd->int_fd(), iov, count);
+    }
+    if (ret != -1 || errno != EINTR) { break; }
+  }
+
+  if (ret == -1) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) { return write_first(); }
+    // Out of memory to pin pages, the data is copied instead
+    if (errno == ENOBUFS && zerocopy) { return write_first(); }
+    shot("Failed to write: $", strerror(errno));
+  }
+  if (zerocopy) {
+    _zerocopy_in_flight.emplace_back(
+      _zerocopy_next_id++, entry.shared.storage());
+  }
+  return ret;
+}
+
 bee::OrError<size_t> AsyncFD::_write(const std::byte* data, size_t size)
 {
   if (_fd == nullptr) { shot("FD already closed"); }
@@ -114,9 +339,7 @@ Task<bee::OrError<bee::ReadResult>> AsyncFD::read_async(bee::DataBuffer& buf)
   while (true) {
     co_bail(result, _read(buf));
     if (result.bytes_read() > 0 || result.is_eof()) { co_return result; }
-    _wait_ready = Ivar<>::create();
-    co_await _wait_ready;
-    _wait_ready = nullptr;
+    co_await wait_readable();
   }
 }
 
@@ -133,13 +356,21 @@ bee::OrError<bee::ReadResult> AsyncFD::_read(bee::DataBuffer& buf)
 bool AsyncFD::close()
 {
   if (_fd == nullptr) { return false; }
+  // Give corked data the same single attempt an uncorked write would have had
+  if (_flush_scheduled) { [[maybe_unused]] auto result = _maybe_write(); }
   remove_fd(_fd);
-  auto ret = _fd->close();
-  _fd = nullptr;
-  if (_flushed_ivar != nullptr) {
-    _flushed_ivar->fill(bee::ok());
-    _flushed_ivar = nullptr;
+  bool ret = true;
+  if (_zerocopy_in_flight.empty()) {
+    ret = _fd->close();
+  } else {
+    _close_after_zerocopy(
+      _fd, std::move(_zerocopy_in_flight), _zerocopy_close_timeout);
+    _zerocopy_in_flight.clear();
   }
+  _fd = nullptr;
+  fill_waiters(_flushed_ivar, bee::ok());
+  fill_waiters(_writable_ivar, bee::ok());
+  _wake_waiters();
   if (_closed_ivar != nullptr && !_closed_ivar->is_determined()) {
     _closed_ivar->fill(bee::unit);
   }
@@ -159,13 +390,236 @@ bee::OrError<optional<AsyncFD::ptr>> AsyncFD::accept()
 
 Task<bee::OrError<>> AsyncFD::flushed()
 {
-  if (_outgoing.empty()) { co_return bee::ok(); }
+  if (_write_error.has_value()) { co_return *_write_error; }
+  if (_outgoing_bytes == 0 && _zerocopy_in_flight.empty()) {
+    co_return bee::ok();
+  }
   if (_flushed_ivar == nullptr) {
     _flushed_ivar = IvarMulti<bee::OrError<>>::create();
   }
   co_return co_await _flushed_ivar->deferred_value();
 }
 
+void AsyncFD::set_write_watermarks(size_t high, size_t low)
+{
+  assert(low <= high);
+  _high_watermark = high;
+  _low_watermark = low;
+  if (_outgoing_bytes <= _low_watermark) {
+    fill_waiters(_writable_ivar, bee::ok());
+  }
+}
+
+size_t AsyncFD::pending_bytes() const { return _outgoing_bytes; }
+
+Task<bee::OrError<>> AsyncFD::writable()
+{
+  if (_write_error.has_value()) { co_return *_write_error; }
+  if (is_closed() || _outgoing_bytes <= _high_watermark) {
+    co_return bee::ok();
+  }
+  if (_writable_ivar == nullptr) {
+    _writable_ivar = IvarMulti<bee::OrError<>>::create();
+  }
+  co_return co_await _writable_ivar->deferred_value();
+}
+
+bee::OrError<> AsyncFD::enable_zerocopy(
+  size_t threshold, bee::Span close_timeout)
+{
+  assert(threshold > 0);
+  if (_fd == nullptr) { shot("FD already closed"); }
+  if (!_is_socket) { shot("Zero copy is only supported on sockets"); }
+#ifdef SO_ZEROCOPY
+  int one = 1;
+  if (
+    setsockopt(_fd->int_fd(), SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) ==
+    -1) {
+    shot("Failed to enable zero copy: $", strerror(errno));
+  }
+#else
+  shot("Zero copy is not supported on this platform");
+#endif
+  _zerocopy_threshold = threshold;
+  _zerocopy_close_timeout = close_timeout;
+  return bee::ok();
+}
+
+size_t AsyncFD::zerocopy_in_flight() const
+{
+  return _zerocopy_in_flight.size();
+}
+
+// Each completion covers an inclusive range of send ids
+void AsyncFD::_reap_zerocopy_completions(
+  const FD& fd, ZerocopyInFlight& in_flight)
+{
+#ifndef __APPLE__
+  while (!in_flight.empty()) {
+    char control[128];
+    msghdr msg{};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (::recvmsg(fd.int_fd(), &msg, MSG_ERRQUEUE) == -1) {
+      if (errno == EINTR) { continue; }
+      break;
+    }
+    for (auto cm = CMSG_FIRSTHDR(&msg); cm != nullptr;
+         cm = CMSG_NXTHDR(&msg, cm)) {
+      bool is_recverr =
+        (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+        (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+      if (!is_recverr) { continue; }
+      sock_extended_err err;
+      memcpy(&err, CMSG_DATA(cm), sizeof(err));
+      if (err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+        continue;
+      }
+      uint32_t first = err.ee_info;
+      uint32_t count = err.ee_data - first;
+      std::erase_if(in_flight, [&](const auto& entry) {
+        return entry.first - first <= count;
+      });
+    }
+  }
+#endif
+}
+
+// Closing the socket would drop the completions while the kernel may still
+// read from the buffers. The peer gets EOF right away, the fd and the buffers
+// are kept until every send is released, or until timeout if the peer stalls.
+void AsyncFD::_close_after_zerocopy(
+  const FD::shared_ptr& fd, ZerocopyInFlight&& in_flight, bee::Span timeout)
+{
+  struct Lingering {
+    FD::shared_ptr fd;
+    ZerocopyInFlight pending;
+    std::optional<TimedTaskId> deadline;
+  };
+
+  ::shutdown(fd->int_fd(), SHUT_WR);
+  auto lingering = std::make_shared<Lingering>(
+    Lingering{.fd = fd, .pending = std::move(in_flight), .deadline = {}});
+  // Taken by value, removing the fd callback destroys its captures
+  auto finish = [](std::shared_ptr<Lingering> lingering) {
+    remove_fd(lingering->fd);
+    lingering->fd->close();
+    lingering->pending.clear();
+  };
+  auto result = add_fd(fd, [lingering, finish]() {
+    _reap_zerocopy_completions(*lingering->fd, lingering->pending);
+    if (!lingering->pending.empty()) { return; }
+    if (lingering->deadline.has_value()) { cancel(*lingering->deadline); }
+    finish(lingering);
+  });
+  if (result.is_error()) {
+    fd->close();
+    return;
+  }
+  lingering->deadline =
+    after(timeout, [weak = std::weak_ptr(lingering), finish]() {
+      if (auto ptr = weak.lock()) { finish(ptr); }
+    });
+}
+
+Task<bee::OrError<size_t>> AsyncFD::send_file(
+  const FD& file, off_t offset, size_t len)
+{
+  if (_sending_file) { co_return bee::Error("send_file already running"); }
+  if (_wait_writable != nullptr) {
+    co_return bee::Error("Cannot send a file while waiting to write");
+  }
+  _sending_file = true;
+  // Data queued before has to go out first
+  auto flush_result = co_await flushed();
+  if (flush_result.is_error()) {
+    _sending_file = false;
+    co_return flush_result.error();
+  }
+  auto result = co_await _send_file(file, offset, len);
+  _sending_file = false;
+  co_return result;
+}
+
+Task<bee::OrError<size_t>> AsyncFD::_send_file(
+  const FD& file, off_t offset, size_t len)
+{
+  size_t sent = 0;
+  while (sent < len) {
+    if (_fd == nullptr) { co_return bee::Error("FD already closed"); }
+#ifdef __APPLE__
+    // No usable sendfile for arbitrary fds, copy through user space
+    std::string chunk(std::min(len - sent, send_file_chunk), 0);
+    ssize_t ret = ::pread(file.int_fd(), chunk.data(), chunk.size(), offset);
+    if (ret == -1) {
+      if (errno == EINTR) { continue; }
+      co_return bee::Error::fmt("Failed to read file: $", strerror(errno));
+    }
+    if (ret == 0) { break; }
+    size_t done = 0;
+    while (done < size_t(ret)) {
+      if (_fd == nullptr) { co_return bee::Error("FD already closed"); }
+      co_bail(
+        written,
+        _write(reinterpret_cast<const std::byte*>(chunk.data()) + done,
+               ret - done));
+      if (written == 0) {
+        co_await wait_writable();
+        continue;
+      }
+      done += written;
+    }
+    offset += ret;
+    sent += ret;
+#else
+    ssize_t ret = ::sendfile(_fd->int_fd(), file.int_fd(), &offset, len - sent);
+    if (ret == -1) {
+      if (errno == EINTR) { continue; }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        co_await wait_writable();
+        continue;
+      }
+      co_return bee::Error::fmt("Failed to send file: $", strerror(errno));
+    }
+    // The file is shorter than len
+    if (ret == 0) { break; }
+    sent += ret;
+#endif
+  }
+  co_return sent;
+}
+
+Task<> AsyncFD::wait_readable()
+{
+  if (is_closed()) { co_return; }
+  assert(_wait_ready == nullptr && "Already waiting to read");
+  _wait_ready = Ivar<>::create();
+  co_await _wait_ready;
+  _wait_ready = nullptr;
+}
+
+Task<> AsyncFD::wait_writable()
+{
+  if (is_closed()) { co_return; }
+  assert(_wait_writable == nullptr && "Already waiting to write");
+  want_writable(_fd);
+  _wait_writable = Ivar<>::create();
+  co_await _wait_writable;
+  _wait_writable = nullptr;
+}
+
+// The ivars are reset by the waiters once they resume, the fd can get ready
+// again before that
+void AsyncFD::_wake_waiters()
+{
+  if (_wait_ready != nullptr && !_wait_ready->is_determined()) {
+    _wait_ready->fill();
+  }
+  if (_wait_writable != nullptr && !_wait_writable->is_determined()) {
+    _wait_writable->fill();
+  }
+}
+
 Task<> AsyncFD::closed()
 {
   if (is_closed()) { co_return; }
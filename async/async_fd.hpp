@@ -1,14 +1,24 @@
 #pragma once
 
+#include <cstdint>
+#include <deque>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <utility>
+
+#include <sys/types.h>
 
 #include "async.hpp"
 #include "ivar_multi.hpp"
+#include "receive_buffer_pool.hpp"
+#include "shared_buffer.hpp"
 #include "task.hpp"
 
 #include "bee/data_buffer.hpp"
 #include "bee/error.hpp"
 #include "bee/fd.hpp"
+#include "bee/span.hpp"
 
 namespace async {
 
@@ -32,12 +42,46 @@ struct AsyncFD : public std::enable_shared_from_this<AsyncFD> {
 
   [[nodiscard]] Task<> closed();
 
+  // Once more than high bytes are waiting to be sent, writable() waits until
+  // at most low bytes are left. Without watermarks writable() never waits.
+  void set_write_watermarks(size_t high, size_t low);
+
+  [[nodiscard]] Task<bee::OrError<>> writable();
+
+  size_t pending_bytes() const;
+
+  // Sends len bytes of file starting at offset without copying them through
+  // user space. Returns fewer bytes than len only if the file is shorter.
+  // Writes and other send_file calls fail until it returns, and it fails if
+  // someone is in wait_writable().
+  [[nodiscard]] Task<bee::OrError<size_t>> send_file(
+    const bee::FD& file, off_t offset, size_t len);
+
+  // Wait for the next readiness notification after a read or write on the raw
+  // fd returned EAGAIN. Notifications are edge triggered and not split by
+  // direction, so callers have to retry and may need to wait again. Both
+  // return when the fd is closed.
+  [[nodiscard]] Task<> wait_readable();
+  [[nodiscard]] Task<> wait_writable();
+
   [[nodiscard]] bee::OrError<> write(std::string&& data);
   [[nodiscard]] bee::OrError<> write(const std::string& data);
   [[nodiscard]] bee::OrError<> write(bee::DataBuffer&& buffer);
+  // Queues a reference, the data is not copied
+  [[nodiscard]] bee::OrError<> write(const SharedBuffer& buffer);
 
   [[nodiscard]] bee::OrError<bee::ReadResult> read(bee::DataBuffer& buffer);
 
+  // Reads at most size bytes. Returns nullopt if nothing is available yet and
+  // 0 on EOF.
+  [[nodiscard]] bee::OrError<std::optional<size_t>> read_some(
+    std::byte* data, size_t size);
+
+  // Reads at most max_bytes into a slab of the scheduler's receive pool.
+  // Returns nullopt if nothing is available yet and an empty buffer on EOF.
+  [[nodiscard]] bee::OrError<std::optional<PooledBuffer>> read_pooled(
+    size_t max_bytes = std::numeric_limits<size_t>::max());
+
   [[nodiscard]] Task<bee::OrError<bee::ReadResult>> read_async(
     bee::DataBuffer& buffer);
 
@@ -47,24 +91,88 @@ struct AsyncFD : public std::enable_shared_from_this<AsyncFD> {
 
   void set_ready_callback(ready_callback&& ready_callback);
 
+  // When enabled, write() only queues the data, and everything queued during a
+  // tick is flushed once, right before the scheduler waits for events
+  void set_auto_cork(bool enabled);
+
+  // Sockets only. Writes of at least threshold bytes are sent with
+  // MSG_ZEROCOPY: the kernel reads them straight from the written buffer,
+  // which is kept alive until the kernel reports it's done with it. Pinning
+  // pages and handling the completion has a cost of its own, so this only
+  // pays off for large writes. flushed() also waits for those releases, and
+  // close() leaves the socket open until they arrive or close_timeout passes.
+  // After that the buffers are dropped, and data the kernel hasn't sent yet
+  // may go out modified if their memory is reused.
+  [[nodiscard]] bee::OrError<> enable_zerocopy(
+    size_t threshold, bee::Span close_timeout = bee::Span::of_seconds(30));
+
+  // Number of zero copy sends the kernel hasn't released yet
+  size_t zerocopy_in_flight() const;
+
  private:
   explicit AsyncFD(const bee::FD::shared_ptr& fd, bool is_socket);
 
   bee::OrError<size_t> _write(const std::byte* data, size_t size);
+  Task<bee::OrError<size_t>> _send_file(
+    const bee::FD& file, off_t offset, size_t len);
   bee::OrError<bee::ReadResult> _read(bee::DataBuffer& buf);
   void _handle_ready();
 
+  // Queued data, in write order. Consecutive plain writes share an entry.
+  // Shared entries are never modified, they may be queued on other fds too,
+  // and with zero copy the kernel may still read them after they are sent.
+  struct OutgoingEntry {
+    bee::DataBuffer plain;
+    SharedBuffer shared;
+    size_t shared_sent = 0;
+    bool zerocopy = false;
+  };
+
+  // Buffers sent with MSG_ZEROCOPY by send id
+  using ZerocopyInFlight =
+    std::deque<std::pair<uint32_t, std::shared_ptr<const bee::DataBuffer>>>;
+
+  bee::OrError<> _enqueue(bee::DataBuffer&& data);
+  bee::OrError<> _enqueue_shared(const SharedBuffer& data);
+  bee::OrError<> _after_enqueue();
   bee::OrError<> _maybe_write();
+  bee::OrError<size_t> _write_outgoing(OutgoingEntry& entry);
+  static void _reap_zerocopy_completions(
+    const bee::FD& fd, ZerocopyInFlight& in_flight);
+  static void _close_after_zerocopy(
+    const bee::FD::shared_ptr& fd,
+    ZerocopyInFlight&& in_flight,
+    bee::Span timeout);
+  void _flush_corked();
+
+  void _wake_waiters();
 
   bee::FD::shared_ptr _fd;
   ready_callback _ready_callback;
   bool _is_socket;
 
   Ivar<>::ptr _wait_ready;
+  Ivar<>::ptr _wait_writable;
+
+  std::deque<OutgoingEntry> _outgoing;
+  size_t _outgoing_bytes = 0;
+
+  size_t _zerocopy_threshold = 0;
+  bee::Span _zerocopy_close_timeout = bee::Span::zero();
+  uint32_t _zerocopy_next_id = 0;
+  ZerocopyInFlight _zerocopy_in_flight;
+
+  bool _sending_file = false;
+
+  bool _auto_cork = false;
+  bool _flush_scheduled = false;
+  std::optional<bee::Error> _write_error;
 
-  bee::DataBuffer _outgoing;
+  size_t _high_watermark = std::numeric_limits<size_t>::max();
+  size_t _low_watermark = 0;
 
   IvarMulti<bee::OrError<>>::ptr _flushed_ivar;
+  IvarMulti<bee::OrError<>>::ptr _writable_ivar;
   IvarMulti<>::ptr _closed_ivar;
 };
 
@@ -1,4 +1,11 @@
 #include "async_fd.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include <unistd.h>
+
 #include "testing.hpp"
 
 #include "bee/fd.hpp"
@@ -31,5 +38,216 @@ ASYNC_TEST(read_async)
   }
 }
 
+ASYNC_TEST(write_many_blocks)
+{
+  must(pipe, DataPipe::create());
+
+  // Larger than the pipe buffer, so the writes are partial
+  bee::DataBuffer data;
+  std::string expected;
+  for (int i = 0; i < 300; i++) {
+    std::string block(1000 + i, 'a' + i % 26);
+    expected += block;
+    data.write(std::move(block));
+  }
+  P("Blocks: $ Bytes: $", 300, expected.size());
+
+  auto reader = [&]() -> Task<std::string> {
+    std::string received;
+    while (true) {
+      bee::DataBuffer buf;
+      must(result, co_await pipe.read_fd->read_async(buf));
+      received += buf.to_string();
+      if (result.is_eof()) { break; }
+    }
+    co_return received;
+  };
+  auto received = reader();
+
+  must_unit(pipe.write_fd->write(std::move(data)));
+  must_unit(co_await pipe.write_fd->flushed());
+  pipe.write_fd->close();
+
+  auto output = co_await received;
+  P("Received: $", output.size());
+  P("Matches: $", output == expected);
+}
+
+ASYNC_TEST(auto_cork)
+{
+  must(pipe, DataPipe::create());
+  pipe.write_fd->set_auto_cork(true);
+
+  for (int i = 0; i < 10; i++) {
+    must_unit(pipe.write_fd->write(F("[$]", i)));
+  }
+
+  bee::DataBuffer buf;
+  must(before, pipe.read_fd->read(buf));
+  P("Read before the tick ends: $", before.bytes_read());
+
+  must_unit(co_await pipe.write_fd->flushed());
+  must_unit(pipe.read_fd->read(buf));
+  P("Read after flushing: $", buf);
+
+  must_unit(pipe.write_fd->write("closing"));
+  pipe.write_fd->close();
+  buf = bee::DataBuffer();
+  must_unit(pipe.read_fd->read(buf));
+  P("Read after closing: $", buf);
+}
+
+ASYNC_TEST(write_watermarks)
+{
+  must(pipe, DataPipe::create());
+  constexpr size_t chunk = 4096;
+  constexpr size_t high = 16 * chunk;
+  pipe.write_fd->set_write_watermarks(high, 4 * chunk);
+
+  auto slow_reader = [&]() -> Task<size_t> {
+    size_t received = 0;
+    while (true) {
+      co_await after(bee::Span::of_millis(1));
+      bee::DataBuffer buf;
+      must(result, pipe.read_fd->read(buf));
+      received += buf.size();
+      if (result.is_eof()) { break; }
+    }
+    co_return received;
+  };
+  auto received = slow_reader();
+
+  size_t max_pending = 0;
+  size_t waits = 0;
+  for (int i = 0; i < 200; i++) {
+    if (pipe.write_fd->pending_bytes() > high) { waits++; }
+    must_unit(co_await pipe.write_fd->writable());
+    must_unit(pipe.write_fd->write(std::string(chunk, 'x')));
+    max_pending = std::max(max_pending, pipe.write_fd->pending_bytes());
+  }
+  must_unit(co_await pipe.write_fd->flushed());
+  pipe.write_fd->close();
+
+  P("Waited for the reader: $", waits > 0);
+  P("Max pending within bounds: $", max_pending <= high + chunk);
+  P("Received: $", co_await received);
+}
+
+ASYNC_TEST(send_file)
+{
+  std::string path = "/tmp/async_fd_test_XXXXXX";
+  bee::FD file(mkstemp(path.data()));
+  unlink(path.c_str());
+
+  std::string content;
+  for (int i = 0; i < 50000; i++) { content += F("$,", i); }
+  must_unit(file.write(content));
+
+  must(pipe, DataPipe::create());
+
+  auto reader = [&]() -> Task<std::string> {
+    std::string received;
+    while (true) {
+      bee::DataBuffer buf;
+      must(result, co_await pipe.read_fd->read_async(buf));
+      received += buf.to_string();
+      if (result.is_eof()) { break; }
+    }
+    co_return received;
+  };
+  auto received = reader();
+
+  must_unit(pipe.write_fd->write("header;"));
+  must(sent, co_await pipe.write_fd->send_file(file, 6, content.size()));
+  P("Sent: $", sent);
+  pipe.write_fd->close();
+
+  auto output = co_await received;
+  P("Matches: $", output == "header;" + content.substr(6));
+}
+
+ASYNC_TEST(write_during_send_file)
+{
+  std::string path = "/tmp/async_fd_test_XXXXXX";
+  bee::FD file(mkstemp(path.data()));
+  unlink(path.c_str());
+
+  // More than the pipe holds, so send_file has to wait for the reader
+  std::string content(1024 * 1024, 'f');
+  must_unit(file.write(content));
+
+  must(pipe, DataPipe::create());
+
+  auto sending = pipe.write_fd->send_file(file, 0, content.size());
+  P("Write rejected: $", pipe.write_fd->write("x").is_error());
+  auto second = co_await pipe.write_fd->send_file(file, 0, 1);
+  P("Second send_file rejected: $", second.is_error());
+
+  auto reader = [&]() -> Task<std::string> {
+    std::string received;
+    while (true) {
+      bee::DataBuffer buf;
+      must(result, co_await pipe.read_fd->read_async(buf));
+      received += buf.to_string();
+      if (result.is_eof()) { break; }
+    }
+    co_return received;
+  };
+  auto received = reader();
+
+  must(sent, co_await sending);
+  P("Sent: $", sent);
+  must_unit(pipe.write_fd->write("trailer"));
+  must_unit(co_await pipe.write_fd->flushed());
+  pipe.write_fd->close();
+
+  auto output = co_await received;
+  P("Matches: $", output == content + "trailer");
+}
+
+ASYNC_TEST(shared_buffer)
+{
+  std::string content;
+  for (int i = 0; i < 100000; i++) { content += F("$,", i); }
+  SharedBuffer shared(content);
+  auto tail = shared.slice(shared.size() - 10, 10);
+  P("Tail: $", tail.to_string());
+
+  auto read_all = [](AsyncFD::ptr fd) -> Task<std::string> {
+    std::string received;
+    while (true) {
+      bee::DataBuffer buf;
+      must(result, co_await fd->read_async(buf));
+      received += buf.to_string();
+      if (result.is_eof()) { break; }
+    }
+    co_return received;
+  };
+
+  std::vector<DataPipe> pipes;
+  std::vector<Task<std::string>> received;
+  for (int i = 0; i < 3; i++) {
+    must(pipe, DataPipe::create());
+    received.push_back(read_all(pipe.read_fd));
+    pipes.push_back(std::move(pipe));
+  }
+
+  for (auto& pipe : pipes) {
+    must_unit(pipe.write_fd->write("head;"));
+    must_unit(pipe.write_fd->write(shared));
+    must_unit(pipe.write_fd->write(tail));
+  }
+  for (auto& pipe : pipes) {
+    must_unit(co_await pipe.write_fd->flushed());
+    pipe.write_fd->close();
+  }
+
+  for (auto& task : received) {
+    auto output = co_await task;
+    P("Matches: $", output == "head;" + content + tail.to_string());
+  }
+  P("Shared storage: $", shared.storage() == tail.storage());
+}
+
 } // namespace
 } // namespace async
@@ -0,0 +1,114 @@
+#include "async_file.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using bee::FD;
+using std::string;
+
+namespace async {
+
+// Jobs hold their own reference to the fd, so it stays open until every
+// queued call on it is done
+
+AsyncFile::AsyncFile(IoThreadPool::ptr pool, FD::shared_ptr fd)
+    : _pool(std::move(pool)), _fd(std::move(fd))
+{}
+
+Task<bee::OrError<AsyncFile::ptr>> AsyncFile::open(
+  IoThreadPool::ptr pool, string path, int flags, mode_t mode)
+{
+  auto opened =
+    pool->run([path, flags, mode]() -> bee::OrError<FD::shared_ptr> {
+      int fd = ::open(path.c_str(), flags | O_CLOEXEC, mode);
+      if (fd == -1) { shot("Failed to open '$': $", path, strerror(errno)); }
+      return FD(fd).to_shared();
+    });
+  co_bail(fd, co_await opened);
+  co_return of_fd(std::move(pool), std::move(fd));
+}
+
+AsyncFile::ptr AsyncFile::of_fd(IoThreadPool::ptr pool, FD::shared_ptr fd)
+{
+  return ptr(new AsyncFile(std::move(pool), std::move(fd)));
+}
+
+Task<bee::OrError<string>> AsyncFile::pread(off_t offset, size_t len)
+{
+  return _pool->run(
+    [fd = _fd, offset, len]() -> bee::OrError<string> {
+      string output(len, '\0');
+      size_t done = 0;
+      while (done < len) {
+        ssize_t ret = ::pread(
+          fd->int_fd(), output.data() + done, len - done, offset + done);
+        if (ret == -1) {
+          if (errno == EINTR) { continue; }
+          shot("Failed to read file: $", strerror(errno));
+        }
+        if (ret == 0) { break; }
+        done += ret;
+      }
+      output.resize(done);
+      return output;
+    });
+}
+
+Task<bee::OrError<>> AsyncFile::pwrite(off_t offset, string data)
+{
+  return _pool->run(
+    [fd = _fd, offset, data = std::move(data)]() -> bee::OrError<> {
+      size_t done = 0;
+      while (done < data.size()) {
+        ssize_t ret = ::pwrite(
+          fd->int_fd(), data.data() + done, data.size() - done, offset + done);
+        if (ret == -1) {
+          if (errno == EINTR) { continue; }
+          shot("Failed to write file: $", strerror(errno));
+        }
+        done += ret;
+      }
+      return bee::ok();
+    });
+}
+
+Task<bee::OrError<>> AsyncFile::fsync()
+{
+  return _pool->run([fd = _fd]() -> bee::OrError<> {
+    if (::fsync(fd->int_fd()) == -1) {
+      shot("Failed to fsync: $", strerror(errno));
+    }
+    return bee::ok();
+  });
+}
+
+Task<bee::OrError<>> AsyncFile::fdatasync()
+{
+#ifdef __APPLE__
+  return fsync();
+#else
+  return _pool->run([fd = _fd]() -> bee::OrError<> {
+    if (::fdatasync(fd->int_fd()) == -1) {
+      shot("Failed to fdatasync: $", strerror(errno));
+    }
+    return bee::ok();
+  });
+#endif
+}
+
+Task<bee::OrError<off_t>> AsyncFile::size()
+{
+  return _pool->run([fd = _fd]() -> bee::OrError<off_t> {
+    struct stat st;
+    if (::fstat(fd->int_fd(), &st) == -1) {
+      shot("Failed to stat file: $", strerror(errno));
+    }
+    return st.st_size;
+  });
+}
+
+} // namespace async
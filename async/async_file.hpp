@@ -0,0 +1,55 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <sys/types.h>
+
+#include "io_thread_pool.hpp"
+#include "task.hpp"
+
+#include "bee/error.hpp"
+#include "bee/fd.hpp"
+
+namespace async {
+
+// Regular files can't be polled, they always look ready and a read that
+// misses the page cache blocks. AsyncFile runs each call on an IoThreadPool
+// and resumes the caller on the scheduler thread once it's done.
+//
+// Operations may run concurrently and complete in any order.
+struct AsyncFile {
+ public:
+  using ptr = std::shared_ptr<AsyncFile>;
+
+  AsyncFile(const AsyncFile&) = delete;
+  AsyncFile(AsyncFile&&) = delete;
+
+  static Task<bee::OrError<ptr>> open(
+    IoThreadPool::ptr pool, std::string path, int flags, mode_t mode = 0644);
+
+  static ptr of_fd(IoThreadPool::ptr pool, bee::FD::shared_ptr fd);
+
+  // Returns fewer than len bytes only at the end of the file
+  [[nodiscard]] Task<bee::OrError<std::string>> pread(
+    off_t offset, size_t len);
+
+  [[nodiscard]] Task<bee::OrError<>> pwrite(off_t offset, std::string data);
+
+  [[nodiscard]] Task<bee::OrError<>> fsync();
+  [[nodiscard]] Task<bee::OrError<>> fdatasync();
+
+  [[nodiscard]] Task<bee::OrError<off_t>> size();
+
+  const bee::FD::shared_ptr& fd() const { return _fd; }
+
+  const IoThreadPool::ptr& pool() const { return _pool; }
+
+ private:
+  AsyncFile(IoThreadPool::ptr pool, bee::FD::shared_ptr fd);
+
+  IoThreadPool::ptr _pool;
+  bee::FD::shared_ptr _fd;
+};
+
+} // namespace async
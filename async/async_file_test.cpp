@@ -0,0 +1,73 @@
+#include "async_file.hpp"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "testing.hpp"
+
+namespace async {
+namespace {
+
+ASYNC_TEST(read_write)
+{
+  must(pool, IoThreadPool::create(2, 4));
+  std::string path = F("/tmp/async_file_test_$", getpid());
+  must(file, co_await AsyncFile::open(pool, path, O_RDWR | O_CREAT | O_TRUNC));
+  unlink(path.c_str());
+
+  // More writes than slots, so some of them wait for one
+  std::vector<Task<bee::OrError<>>> writes;
+  for (int i = 0; i < 16; i++) {
+    writes.push_back(file->pwrite(i * 3, F("<$>", char('a' + i))));
+  }
+  for (auto& write : writes) { must_unit(co_await write); }
+  must_unit(co_await file->fdatasync());
+
+  must(size, co_await file->size());
+  P("Size: $", size);
+
+  auto main_thread = std::this_thread::get_id();
+  must(middle, co_await file->pread(6, 9));
+  P("Middle: $", middle);
+  P("On the scheduler thread: $", std::this_thread::get_id() == main_thread);
+
+  must(tail, co_await file->pread(45, 100));
+  P("Tail: $", tail);
+  must(past_end, co_await file->pread(1000, 10));
+  P("Past end: '$'", past_end);
+}
+
+ASYNC_TEST(errors)
+{
+  must(pool, IoThreadPool::create(1));
+  auto missing =
+    co_await AsyncFile::open(pool, "/nonexistent/async_file_test", O_RDONLY);
+  P("Missing: $", missing.is_error());
+
+  pool->close();
+  auto noop = []() -> bee::OrError<> { return bee::ok(); };
+  auto closed = co_await pool->run(noop);
+  P("After close: $", closed.is_error() ? closed.error().msg() : "ok");
+}
+
+ASYNC_TEST(pool_dropped_while_running)
+{
+  std::string path = F("/tmp/async_file_test_dropped_$", getpid());
+  Task<bee::OrError<>> write = bee::ok();
+  {
+    must(pool, IoThreadPool::create(1));
+    must(file, co_await AsyncFile::open(pool, path, O_RDWR | O_CREAT));
+    unlink(path.c_str());
+    write = file->pwrite(0, "data");
+  }
+  // The pending write holds the last reference to the pool
+  auto result = co_await write;
+  P("Write: $", result.is_error() ? result.error().msg() : "ok");
+}
+
+} // namespace
+} // namespace async
@@ -0,0 +1,184 @@
+#include "async_log_writer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "deferred_awaitable.hpp"
+#include "scheduler_context.hpp"
+
+using std::string;
+using std::vector;
+
+namespace async {
+
+namespace {
+
+constexpr size_t max_iovecs = std::min(IOV_MAX, 1024);
+
+// Writes all records in order, retrying after short writes
+bee::OrError<> write_records(int fd, const vector<string>& records)
+{
+  size_t index = 0;
+  size_t offset = 0;
+  while (index < records.size()) {
+    iovec iov[max_iovecs];
+    int count = 0;
+    for (size_t i = index; i < records.size(); i++) {
+      if (count == int(max_iovecs)) { break; }
+      size_t skip = i == index ? offset : 0;
+      iov[count].iov_base = const_cast<char*>(records[i].data()) + skip;
+      iov[count].iov_len = records[i].size() - skip;
+      count++;
+    }
+    ssize_t ret = ::writev(fd, iov, count);
+    if (ret == -1) {
+      if (errno == EINTR) { continue; }
+      shot("Failed to write log: $", strerror(errno));
+    }
+    size_t written = ret;
+    while (index < records.size() &&
+           written >= records[index].size() - offset) {
+      written -= records[index].size() - offset;
+      index++;
+      offset = 0;
+    }
+    offset += written;
+  }
+  return bee::ok();
+}
+
+} // namespace
+
+AsyncLogWriter::AsyncLogWriter(AsyncFile::ptr file, const Options& options)
+    : _file(std::move(file)), _options(options)
+{}
+
+AsyncLogWriter::ptr AsyncLogWriter::create(
+  AsyncFile::ptr file, const Options& options)
+{
+  assert(options.max_batch_bytes > 0 && options.max_batch_records > 0);
+  return ptr(new AsyncLogWriter(std::move(file), options));
+}
+
+Task<bee::OrError<AsyncLogWriter::ptr>> AsyncLogWriter::open(
+  IoThreadPool::ptr pool, string path, Options options)
+{
+  co_bail(
+    file,
+    co_await AsyncFile::open(
+      std::move(pool), std::move(path), O_WRONLY | O_CREAT | O_APPEND));
+  co_return create(std::move(file), options);
+}
+
+Task<bee::OrError<>> AsyncLogWriter::append(string record)
+{
+  if (_error.has_value()) { co_return *_error; }
+  if (_closed) { co_return bee::Error("Log writer is closed"); }
+
+  if (_queue.empty() || _is_full(_queue.back())) { _queue.emplace_back(); }
+  auto& batch = _queue.back();
+  batch.bytes += record.size();
+  batch.records.push_back(std::move(record));
+  auto ivar = Ivar<bee::OrError<>>::create();
+  batch.waiters.push_back(ivar);
+  if (
+    _front_full != nullptr && !_front_full->is_determined() &&
+    _is_full(_queue.front())) {
+    _front_full->fill();
+  }
+
+  if (!_committing) {
+    _committing = true;
+    schedule_task(_commit_loop, shared_from_this());
+  }
+  co_return co_await ivar;
+}
+
+Task<bee::OrError<>> AsyncLogWriter::close()
+{
+  _closed = true;
+  // The last batch won't get any more records
+  if (_front_full != nullptr && !_front_full->is_determined()) {
+    _front_full->fill();
+  }
+  if (_committing) {
+    auto ivar = Ivar<>::create();
+    _idle_waiters.push_back(ivar);
+    co_await ivar;
+  }
+  if (_error.has_value()) { co_return *_error; }
+  co_return bee::ok();
+}
+
+bool AsyncLogWriter::_is_full(const Batch& batch) const
+{
+  return batch.bytes >= _options.max_batch_bytes ||
+         batch.records.size() >= _options.max_batch_records;
+}
+
+Task<> AsyncLogWriter::_commit_loop(ptr self)
+{
+  while (!self->_queue.empty()) {
+    if (
+      self->_options.max_delay.is_positive() && !self->_closed &&
+      !self->_is_full(self->_queue.front())) {
+      auto front_full = Ivar<>::create();
+      self->_front_full = front_full;
+      auto timer = async::after(self->_options.max_delay, [front_full]() {
+        if (!front_full->is_determined()) { front_full->fill(); }
+      });
+      co_await front_full;
+      self->_front_full = nullptr;
+      async::cancel(timer);
+    }
+
+    auto batch = std::move(self->_queue.front());
+    self->_queue.pop_front();
+
+    bee::OrError<> result = bee::ok();
+    if (self->_error.has_value()) {
+      result = *self->_error;
+    } else {
+      auto write = self->_write(std::move(batch.records));
+      result = co_await write;
+      if (result.is_error()) {
+        self->_error = result.error();
+      } else {
+        self->_batches_committed++;
+        self->_records_committed += batch.waiters.size();
+      }
+    }
+    for (auto& waiter : batch.waiters) { waiter->fill(result); }
+  }
+
+  self->_committing = false;
+  auto waiters = std::move(self->_idle_waiters);
+  self->_idle_waiters.clear();
+  for (auto& waiter : waiters) { waiter->fill(); }
+}
+
+Task<bee::OrError<>> AsyncLogWriter::_write(vector<string> records)
+{
+  return _file->pool()->run(
+    [fd = _file->fd(), records = std::move(records), sync = _options.sync]()
+      -> bee::OrError<> {
+      bail_unit(write_records(fd->int_fd(), records));
+      if (!sync) { return bee::ok(); }
+#ifdef __APPLE__
+      int ret = ::fsync(fd->int_fd());
+#else
+      int ret = ::fdatasync(fd->int_fd());
+#endif
+      if (ret == -1) { shot("Failed to sync log: $", strerror(errno)); }
+      return bee::ok();
+    });
+}
+
+} // namespace async
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "async.hpp"
+#include "async_file.hpp"
+#include "task.hpp"
+
+#include "bee/error.hpp"
+#include "bee/span.hpp"
+
+namespace async {
+
+// Append only log with group commit. Records appended while a batch is being
+// written and synced are collected into the next batch, which is written with
+// one writev and synced with one fdatasync. Callers resume once the batch
+// holding their record is durable.
+//
+// A failed batch fails every later append too, the state of the end of the
+// file is unknown after that.
+struct AsyncLogWriter : public std::enable_shared_from_this<AsyncLogWriter> {
+ public:
+  using ptr = std::shared_ptr<AsyncLogWriter>;
+
+  struct Options {
+    size_t max_batch_bytes = 1024 * 1024;
+    size_t max_batch_records = 4096;
+    // How long a batch waits for more records before it's written. With
+    // zero, it's written as soon as the previous one is done. A batch that
+    // fills up is written without waiting.
+    bee::Span max_delay = bee::Span::zero();
+    // Without sync, callers resume once the data is written
+    bool sync = true;
+  };
+
+  AsyncLogWriter(const AsyncLogWriter&) = delete;
+  AsyncLogWriter(AsyncLogWriter&&) = delete;
+
+  // The file should be opened with O_APPEND
+  static ptr create(AsyncFile::ptr file, const Options& options);
+
+  static Task<bee::OrError<ptr>> open(
+    IoThreadPool::ptr pool, std::string path, Options options);
+
+  // The record is written as is, framing is up to the caller
+  [[nodiscard]] Task<bee::OrError<>> append(std::string record);
+
+  // Fails new appends, and waits for the queued ones to be committed. They
+  // are written right away, without waiting for max_delay.
+  [[nodiscard]] Task<bee::OrError<>> close();
+
+  size_t batches_committed() const { return _batches_committed; }
+  size_t records_committed() const { return _records_committed; }
+
+ private:
+  AsyncLogWriter(AsyncFile::ptr file, const Options& options);
+
+  struct Batch {
+    std::vector<std::string> records;
+    std::vector<Ivar<bee::OrError<>>::ptr> waiters;
+    size_t bytes = 0;
+  };
+
+  bool _is_full(const Batch& batch) const;
+
+  static Task<> _commit_loop(ptr self);
+  Task<bee::OrError<>> _write(std::vector<std::string> records);
+
+  AsyncFile::ptr _file;
+  Options _options;
+
+  std::deque<Batch> _queue;
+  bool _committing = false;
+  bool _closed = false;
+  std::optional<bee::Error> _error;
+  std::vector<Ivar<>::ptr> _idle_waiters;
+  // Set while the commit loop waits for the front batch to fill up
+  Ivar<>::ptr _front_full;
+
+  size_t _batches_committed = 0;
+  size_t _records_committed = 0;
+};
+
+} // namespace async
@@ -0,0 +1,129 @@
+#include "async_log_writer.hpp"
+
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "testing.hpp"
+
+#include "bee/time.hpp"
+
+namespace async {
+namespace {
+
+Task<std::string> read_file(IoThreadPool::ptr pool, std::string path)
+{
+  must(file, co_await AsyncFile::open(pool, path, O_RDONLY));
+  must(size, co_await file->size());
+  must(content, co_await file->pread(0, size));
+  co_return content;
+}
+
+ASYNC_TEST(group_commit)
+{
+  must(pool, IoThreadPool::create(2));
+  std::string path = F("/tmp/async_log_writer_test_$", getpid());
+  unlink(path.c_str());
+
+  AsyncLogWriter::Options options;
+  options.max_batch_records = 16;
+  must(writer, co_await AsyncLogWriter::open(pool, path, options));
+
+  std::vector<Task<bee::OrError<>>> appends;
+  for (int i = 0; i < 100; i++) {
+    appends.push_back(writer->append(F("record $\n", i)));
+  }
+  int failed = 0;
+  for (auto& append : appends) {
+    if ((co_await append).is_error()) { failed++; }
+  }
+  P("Failed: $", failed);
+  P("Records committed: $", writer->records_committed());
+  // The first record goes out alone, the other 99 queue up behind it in
+  // batches of at most 16
+  P("Batches committed: $", writer->batches_committed());
+
+  must_unit(co_await writer->close());
+  auto closed = co_await writer->append("late\n");
+  P("Append after close: $", closed.is_error());
+
+  auto content = co_await read_file(pool, path);
+  std::string expected;
+  for (int i = 0; i < 100; i++) { expected += F("record $\n", i); }
+  P("Content matches: $", content == expected);
+  unlink(path.c_str());
+}
+
+ASYNC_TEST(max_delay)
+{
+  must(pool, IoThreadPool::create(1));
+  std::string path = F("/tmp/async_log_writer_test_delay_$", getpid());
+  unlink(path.c_str());
+
+  AsyncLogWriter::Options options;
+  options.max_delay = bee::Span::of_millis(20);
+  options.sync = false;
+  must(writer, co_await AsyncLogWriter::open(pool, path, options));
+
+  auto first = writer->append("a");
+  co_await after(bee::Span::of_millis(5));
+  auto second = writer->append("b");
+  must_unit(co_await first);
+  must_unit(co_await second);
+  P("Batches: $", writer->batches_committed());
+
+  must_unit(co_await writer->close());
+  P("Content: $", co_await read_file(pool, path));
+  unlink(path.c_str());
+}
+
+ASYNC_TEST(full_batch_skips_delay)
+{
+  must(pool, IoThreadPool::create(1));
+  std::string path = F("/tmp/async_log_writer_test_full_$", getpid());
+  unlink(path.c_str());
+
+  AsyncLogWriter::Options options;
+  options.max_batch_records = 4;
+  options.max_delay = bee::Span::of_seconds(10);
+  options.sync = false;
+  must(writer, co_await AsyncLogWriter::open(pool, path, options));
+
+  auto start = bee::Time::monotonic();
+  std::vector<Task<bee::OrError<>>> appends;
+  for (int i = 0; i < 4; i++) { appends.push_back(writer->append("x")); }
+  for (auto& append : appends) { must_unit(co_await append); }
+  P("Batches: $", writer->batches_committed());
+  P("Didn't wait for the delay: $",
+    bee::Time::monotonic() - start < options.max_delay);
+
+  must_unit(co_await writer->close());
+  unlink(path.c_str());
+}
+
+ASYNC_TEST(close_skips_delay)
+{
+  must(pool, IoThreadPool::create(1));
+  std::string path = F("/tmp/async_log_writer_test_close_$", getpid());
+  unlink(path.c_str());
+
+  AsyncLogWriter::Options options;
+  options.max_delay = bee::Span::of_seconds(10);
+  options.sync = false;
+  must(writer, co_await AsyncLogWriter::open(pool, path, options));
+
+  auto start = bee::Time::monotonic();
+  auto append = writer->append("x");
+  must_unit(co_await writer->close());
+  must_unit(co_await append);
+  P("Records: $", writer->records_committed());
+  P("Didn't wait for the delay: $",
+    bee::Time::monotonic() - start < options.max_delay);
+
+  unlink(path.c_str());
+}
+
+} // namespace
+} // namespace async
@@ -0,0 +1,189 @@
+#include "async_reader.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+using std::nullopt;
+using std::string_view;
+
+namespace async {
+
+AsyncReader::AsyncReader(AsyncFD::ptr fd, const Options& options)
+    : _fd(std::move(fd)), _options(options)
+{}
+
+AsyncReader::ptr AsyncReader::create(AsyncFD::ptr fd)
+{
+  return create(std::move(fd), Options());
+}
+
+AsyncReader::ptr AsyncReader::create(AsyncFD::ptr fd, const Options& options)
+{
+  assert(options.initial_buffer_size > 0);
+  return ptr(new AsyncReader(std::move(fd), options));
+}
+
+Task<AsyncReader::read_result> AsyncReader::read_exact(size_t size)
+{
+  co_await _wait_turn();
+  Turn turn{this};
+  while (buffered() < size) {
+    co_bail(bytes_read, co_await _fill(size));
+    if (bytes_read > 0) { continue; }
+    if (buffered() == 0) { co_return nullopt; }
+    co_return bee::Error::fmt(
+      "Unexpected EOF, expected $ bytes but got $", size, buffered());
+  }
+  co_return _take(size);
+}
+
+Task<AsyncReader::read_result> AsyncReader::read_until(std::string delim)
+{
+  assert(!delim.empty());
+  co_await _wait_turn();
+  Turn turn{this};
+  // Only the new data and the part of the old one a delimiter could start in
+  // are searched again after each read
+  size_t searched = 0;
+  while (true) {
+    string_view data(_buffer.data() + _start, buffered());
+    size_t pos = data.find(delim, searched);
+    if (pos != string_view::npos) { co_return _take(pos, delim.size()); }
+    if (data.size() >= delim.size()) {
+      searched = data.size() - delim.size() + 1;
+    }
+    co_bail(bytes_read, co_await _fill(buffered() + 1));
+    if (bytes_read > 0) { continue; }
+    if (buffered() == 0) { co_return nullopt; }
+    co_return bee::Error::fmt(
+      "Unexpected EOF, $ bytes left without a delimiter", buffered());
+  }
+}
+
+Task<AsyncReader::read_result> AsyncReader::read_line()
+{
+  co_await _wait_turn();
+  Turn turn{this};
+  size_t searched = 0;
+  while (true) {
+    string_view data(_buffer.data() + _start, buffered());
+    size_t pos = data.find('\n', searched);
+    if (pos != string_view::npos) {
+      if (pos > 0 && data[pos - 1] == '\r') { co_return _take(pos - 1, 2); }
+      co_return _take(pos, 1);
+    }
+    searched = data.size();
+    co_bail(bytes_read, co_await _fill(buffered() + 1));
+    if (bytes_read > 0) { continue; }
+    if (buffered() == 0) { co_return nullopt; }
+    co_return _take(buffered());
+  }
+}
+
+Task<AsyncReader::read_result> AsyncReader::_read_frame(size_t prefix_size)
+{
+  co_await _wait_turn();
+  Turn turn{this};
+  while (buffered() < prefix_size) {
+    co_bail(bytes_read, co_await _fill(prefix_size));
+    if (bytes_read > 0) { continue; }
+    if (buffered() == 0) { co_return nullopt; }
+    co_return bee::Error::fmt(
+      "Unexpected EOF in a frame header, got $ bytes", buffered());
+  }
+
+  uint64_t length = 0;
+  for (size_t i = 0; i < prefix_size; i++) {
+    length = (length << 8) | uint8_t(_buffer[_start + i]);
+  }
+  if (length > _options.max_buffer_size - prefix_size) {
+    co_return bee::Error::fmt(
+      "Frame of $ bytes is larger than the maximum of $",
+      length,
+      _options.max_buffer_size - prefix_size);
+  }
+
+  size_t size = prefix_size + length;
+  while (buffered() < size) {
+    co_bail(bytes_read, co_await _fill(size));
+    if (bytes_read > 0) { continue; }
+    co_return bee::Error::fmt(
+      "Unexpected EOF, frame of $ bytes but got $",
+      length,
+      buffered() - prefix_size);
+  }
+  _start += prefix_size;
+  co_return _take(length);
+}
+
+Task<> AsyncReader::_wait_turn()
+{
+  if (!_busy) {
+    _busy = true;
+    co_return;
+  }
+  auto ivar = Ivar<>::create();
+  _turn_waiters.push_back(ivar);
+  co_await ivar;
+}
+
+void AsyncReader::_end_turn()
+{
+  if (_turn_waiters.empty()) {
+    _busy = false;
+    return;
+  }
+  // The next read resumes through the scheduler, after the caller of this one
+  _turn_waiters.front()->fill();
+  _turn_waiters.pop_front();
+}
+
+Task<bee::OrError<size_t>> AsyncReader::_fill(size_t size)
+{
+  if (size > _options.max_buffer_size) {
+    co_return bee::Error::fmt(
+      "Read of $ bytes is larger than the maximum of $",
+      size,
+      _options.max_buffer_size);
+  }
+
+  if (_start == _end) { _start = _end = 0; }
+  // Data is only moved when there is no room left after it, or the unit being
+  // read wouldn't fit
+  if (_end == _buffer.size() || _start + size > _buffer.size()) {
+    if (_start > 0) {
+      memmove(_buffer.data(), _buffer.data() + _start, buffered());
+      _end -= _start;
+      _start = 0;
+    }
+    if (_end == _buffer.size() || size > _buffer.size()) {
+      size_t new_size = std::max(
+        {size, _buffer.size() * 2, _options.initial_buffer_size});
+      _buffer.resize(std::min(new_size, _options.max_buffer_size));
+    }
+  }
+
+  while (true) {
+    co_bail(
+      ret,
+      _fd->read_some(
+        reinterpret_cast<std::byte*>(_buffer.data()) + _end,
+        _buffer.size() - _end));
+    if (!ret.has_value()) {
+      co_await _fd->wait_readable();
+      continue;
+    }
+    _end += *ret;
+    co_return *ret;
+  }
+}
+
+string_view AsyncReader::_take(size_t size, size_t skip_after)
+{
+  string_view output(_buffer.data() + _start, size);
+  _start += size + skip_after;
+  return output;
+}
+
+} // namespace async
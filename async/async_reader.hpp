@@ -0,0 +1,99 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "async.hpp"
+#include "async_fd.hpp"
+#include "task.hpp"
+
+#include "bee/error.hpp"
+
+namespace async {
+
+// Buffered reads of whole protocol units from an AsyncFD.
+//
+// Results are views into the reader's buffer. A view stays valid until the
+// next read on this reader runs, the buffer is only compacted or grown when
+// more data has to be read. Reads can be started while another one is still
+// waiting, they are served in the order they were started.
+//
+// All reads return nullopt on EOF when nothing is left in the buffer, and an
+// error if the EOF cuts a unit short.
+struct AsyncReader {
+ public:
+  using ptr = std::shared_ptr<AsyncReader>;
+
+  struct Options {
+    size_t initial_buffer_size = 16 * 1024;
+    // Units larger than this are an error
+    size_t max_buffer_size = 16 * 1024 * 1024;
+  };
+
+  AsyncReader(const AsyncReader&) = delete;
+  AsyncReader(AsyncReader&&) = delete;
+
+  static ptr create(AsyncFD::ptr fd);
+  static ptr create(AsyncFD::ptr fd, const Options& options);
+
+  using read_result = bee::OrError<std::optional<std::string_view>>;
+
+  [[nodiscard]] Task<read_result> read_exact(size_t size);
+
+  // Returns the data before delim, the delimiter itself is consumed
+  [[nodiscard]] Task<read_result> read_until(std::string delim);
+
+  // Strips the "\n" or "\r\n" terminator. A last line without one is returned
+  // as is.
+  [[nodiscard]] Task<read_result> read_line();
+
+  // A frame is a big endian length of type T followed by that many bytes
+  template <std::unsigned_integral T = uint32_t>
+  [[nodiscard]] Task<read_result> read_frame()
+  {
+    return _read_frame(sizeof(T));
+  }
+
+  // Bytes read from the fd that haven't been returned yet
+  size_t buffered() const { return _end - _start; }
+
+  const AsyncFD::ptr& fd() const { return _fd; }
+
+ private:
+  AsyncReader(AsyncFD::ptr fd, const Options& options);
+
+  // Ends the current turn when the read that started it returns
+  struct Turn {
+    AsyncReader* reader;
+    ~Turn() { reader->_end_turn(); }
+  };
+
+  Task<> _wait_turn();
+  void _end_turn();
+
+  Task<read_result> _read_frame(size_t prefix_size);
+
+  // Reads more data while keeping at least size bytes from _start contiguous.
+  // Returns 0 on EOF.
+  Task<bee::OrError<size_t>> _fill(size_t size);
+
+  std::string_view _take(size_t size, size_t skip_after = 0);
+
+  AsyncFD::ptr _fd;
+  Options _options;
+
+  std::string _buffer;
+  size_t _start = 0;
+  size_t _end = 0;
+
+  bool _busy = false;
+  std::deque<Ivar<>::ptr> _turn_waiters;
+};
+
+} // namespace async
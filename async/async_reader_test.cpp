@@ -0,0 +1,128 @@
+#include "async_reader.hpp"
+
+#include <string>
+#include <vector>
+
+#include "testing.hpp"
+
+namespace async {
+namespace {
+
+AsyncReader::Options small_buffer()
+{
+  return AsyncReader::Options{
+    .initial_buffer_size = 4,
+    .max_buffer_size = 1024,
+  };
+}
+
+void print_error(const AsyncReader::read_result& result)
+{
+  if (result.is_error()) {
+    P("Error: $", result.error());
+  } else {
+    P("No error");
+  }
+}
+
+template <class T> std::string frame(const std::string& payload)
+{
+  std::string output;
+  for (int i = sizeof(T) - 1; i >= 0; i--) {
+    output += char((payload.size() >> (i * 8)) & 0xff);
+  }
+  return output + payload;
+}
+
+ASYNC_TEST(read_line)
+{
+  must(pipe, DataPipe::create());
+  auto reader = AsyncReader::create(pipe.read_fd, small_buffer());
+
+  must_unit(pipe.write_fd->write("hello\nwor"));
+  must(first, co_await reader->read_line());
+  P("Line: '$'", std::string(*first));
+
+  must_unit(pipe.write_fd->write("ld\r\n\nsome longer line\nlast"));
+  pipe.write_fd->close();
+  while (true) {
+    must(line, co_await reader->read_line());
+    if (!line.has_value()) { break; }
+    P("Line: '$'", std::string(*line));
+  }
+  P("EOF");
+}
+
+ASYNC_TEST(read_until)
+{
+  must(pipe, DataPipe::create());
+  auto reader = AsyncReader::create(pipe.read_fd, small_buffer());
+
+  must_unit(pipe.write_fd->write("a||bc|"));
+  must(first, co_await reader->read_until("||"));
+  P("Token: '$'", std::string(*first));
+
+  must_unit(pipe.write_fd->write("|def||tail"));
+  pipe.write_fd->close();
+  must(second, co_await reader->read_until("||"));
+  P("Token: '$'", std::string(*second));
+  must(third, co_await reader->read_until("||"));
+  P("Token: '$'", std::string(*third));
+  print_error(co_await reader->read_until("||"));
+}
+
+ASYNC_TEST(read_exact_and_frames)
+{
+  must(pipe, DataPipe::create());
+  auto reader = AsyncReader::create(pipe.read_fd, small_buffer());
+
+  std::string big(600, 'x');
+  must_unit(pipe.write_fd->write("HEAD"));
+  must_unit(pipe.write_fd->write(frame<uint32_t>("first")));
+  must_unit(pipe.write_fd->write(frame<uint16_t>(big)));
+  must_unit(pipe.write_fd->write(frame<uint8_t>("")));
+  must_unit(pipe.write_fd->write(frame<uint32_t>(std::string(2000, 'y'))));
+  pipe.write_fd->close();
+
+  must(head, co_await reader->read_exact(4));
+  P("Head: '$'", std::string(*head));
+  must(first, co_await reader->read_frame());
+  P("Frame: '$'", std::string(*first));
+  must(second, co_await reader->read_frame<uint16_t>());
+  P("Big frame matches: $", *second == big);
+  must(empty, co_await reader->read_frame<uint8_t>());
+  P("Empty frame: $", empty->size());
+  print_error(co_await reader->read_frame());
+}
+
+ASYNC_TEST(unexpected_eof)
+{
+  must(pipe, DataPipe::create());
+  auto reader = AsyncReader::create(pipe.read_fd);
+
+  must_unit(pipe.write_fd->write("abcd"));
+  pipe.write_fd->close();
+  print_error(co_await reader->read_exact(10));
+}
+
+ASYNC_TEST(concurrent_reads)
+{
+  must(pipe, DataPipe::create());
+  auto reader = AsyncReader::create(pipe.read_fd);
+
+  std::vector<std::string> lines;
+  auto read_one = [&]() -> Task<> {
+    must(line, co_await reader->read_line());
+    lines.emplace_back(*line);
+  };
+  std::vector<Task<>> tasks;
+  for (int i = 0; i < 3; i++) { tasks.push_back(read_one()); }
+
+  must_unit(pipe.write_fd->write("one\ntwo\n"));
+  must_unit(pipe.write_fd->write("three\n"));
+  for (auto& task : tasks) { co_await task; }
+  for (const auto& line : lines) { P("Line: $", line); }
+}
+
+} // namespace
+} // namespace async
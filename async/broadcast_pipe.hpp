@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <concepts>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <vector>
+
+#include "async.hpp"
+#include "deferred_awaitable.hpp"
+#include "task.hpp"
+
+namespace async {
+
+// What happens to a subscriber that falls more than a ring's worth of elements
+// behind the publisher. Applied when a push finds the ring full.
+enum class SlowSubscriberPolicy {
+  // The subscriber skips the elements it missed, see Subscription::dropped()
+  Drop,
+  // The publisher waits until the slowest subscriber catches up
+  Block,
+  // The subscriber is closed, its next read returns nullopt
+  Disconnect,
+};
+
+// Single publisher, many subscribers. Each element is stored once, in a fixed
+// size ring, and every subscriber reads it through its own cursor, so pushing
+// costs the same no matter how many subscribers there are and allocates
+// nothing. A slot is only reused once every subscriber has read or skipped
+// it. Subscribers only see elements pushed after they subscribed.
+template <std::copy_constructible T>
+struct BroadcastPipe : public std::enable_shared_from_this<BroadcastPipe<T>> {
+ public:
+  using ptr = std::shared_ptr<BroadcastPipe<T>>;
+
+  struct Subscription : public std::enable_shared_from_this<Subscription> {
+   public:
+    using ptr = std::shared_ptr<Subscription>;
+
+    Subscription(const Subscription&) = delete;
+    Subscription(Subscription&&) = delete;
+
+    ~Subscription() { _pipe->_unsubscribe(this); }
+
+    // Returns a copy of the next element, or nullopt once the pipe is closed
+    // and this subscriber has read everything, or once it has been
+    // disconnected
+    Task<std::optional<T>> next_value()
+    {
+      return _pipe->_next_value(this->shared_from_this());
+    }
+
+    // Number of elements skipped under SlowSubscriberPolicy::Drop
+    uint64_t dropped() const { return _dropped; }
+
+    bool is_disconnected() const { return _disconnected; }
+
+   private:
+    friend BroadcastPipe;
+
+    Subscription(BroadcastPipe::ptr pipe, uint64_t cursor)
+        : _pipe(std::move(pipe)), _cursor(cursor)
+    {}
+
+    BroadcastPipe::ptr _pipe;
+    uint64_t _cursor;
+    uint64_t _dropped = 0;
+    bool _disconnected = false;
+  };
+
+  BroadcastPipe(const BroadcastPipe&) = delete;
+  BroadcastPipe(BroadcastPipe&&) = delete;
+
+  ~BroadcastPipe() { close(); }
+
+  static ptr create(size_t capacity, SlowSubscriberPolicy policy)
+  {
+    assert(capacity > 0);
+    return ptr(new BroadcastPipe(capacity, policy));
+  }
+
+  typename Subscription::ptr subscribe()
+  {
+    auto subscription = typename Subscription::ptr(
+      new Subscription(this->shared_from_this(), _head));
+    _subscribers.push_back(subscription.get());
+    return subscription;
+  }
+
+  // Returns false if the pipe is closed, or if the policy is Block and the
+  // slowest subscriber is a whole ring behind
+  template <std::convertible_to<T> U> bool push(U&& value)
+  {
+    if (_closed) { return false; }
+    if (_is_full()) {
+      if (_policy == SlowSubscriberPolicy::Block) { return false; }
+      _make_room();
+    }
+    _ring[_head % _ring.size()].emplace(std::forward<U>(value));
+    _head++;
+    _wake_subscribers();
+    return true;
+  }
+
+  // Like push, but waits for room instead of failing when the policy is Block
+  Task<bool> blocking_push(T value)
+  {
+    while (!_closed && _policy == SlowSubscriberPolicy::Block && _is_full()) {
+      auto ivar = Ivar<>::create();
+      _waiting_push.push(ivar);
+      co_await ivar;
+    }
+    co_return push(std::move(value));
+  }
+
+  void close()
+  {
+    if (_closed) { return; }
+    _closed = true;
+    _wake_subscribers();
+    while (!_waiting_push.empty()) {
+      _waiting_push.front()->fill();
+      _waiting_push.pop();
+    }
+  }
+
+  bool is_closed() const { return _closed; }
+
+  size_t capacity() const { return _ring.size(); }
+
+  size_t num_subscribers() const { return _subscribers.size(); }
+
+ private:
+  BroadcastPipe(size_t capacity, SlowSubscriberPolicy policy)
+      : _ring(capacity), _policy(policy)
+  {}
+
+  Task<std::optional<T>> _next_value(typename Subscription::ptr subscription)
+  {
+    auto& sub = *subscription;
+    while (true) {
+      if (sub._disconnected) { co_return std::nullopt; }
+
+      if (sub._cursor < _head) {
+        std::optional<T> value = *_ring[sub._cursor % _ring.size()];
+        sub._cursor++;
+        _maybe_wake_pusher();
+        co_return value;
+      }
+
+      if (_closed) { co_return std::nullopt; }
+
+      auto ivar = Ivar<>::create();
+      _waiting.push_back(ivar);
+      co_await ivar;
+    }
+  }
+
+  void _unsubscribe(Subscription* subscription)
+  {
+    std::erase(_subscribers, subscription);
+    _maybe_wake_pusher();
+  }
+
+  bool _is_full()
+  {
+    // Cursors only move forward, so the cached minimum is only refreshed when
+    // the ring looks full
+    if (_head - _min_cursor < _ring.size()) { return false; }
+    _min_cursor = _head;
+    for (const auto* sub : _subscribers) {
+      _min_cursor = std::min(_min_cursor, sub->_cursor);
+    }
+    return _head - _min_cursor >= _ring.size();
+  }
+
+  // Frees the oldest slot by moving the subscribers still on it out of the way
+  void _make_room()
+  {
+    uint64_t oldest_kept = _head + 1 - _ring.size();
+    for (auto* sub : _subscribers) {
+      if (sub->_cursor >= oldest_kept) { continue; }
+      if (_policy == SlowSubscriberPolicy::Disconnect) {
+        sub->_disconnected = true;
+      } else {
+        sub->_dropped += oldest_kept - sub->_cursor;
+        sub->_cursor = oldest_kept;
+      }
+    }
+    std::erase_if(
+      _subscribers, [](const auto* sub) { return sub->_disconnected; });
+    _min_cursor = oldest_kept;
+  }
+
+  void _wake_subscribers()
+  {
+    if (_waiting.empty()) { return; }
+    auto waiting = std::move(_waiting);
+    _waiting.clear();
+    for (auto& ivar : waiting) { ivar->fill(); }
+  }
+
+  void _maybe_wake_pusher()
+  {
+    if (_waiting_push.empty() || _is_full()) { return; }
+    _waiting_push.front()->fill();
+    _waiting_push.pop();
+  }
+
+  std::vector<std::optional<T>> _ring;
+  uint64_t _head = 0;
+  uint64_t _min_cursor = 0;
+
+  SlowSubscriberPolicy _policy;
+
+  std::vector<Subscription*> _subscribers;
+  std::vector<Ivar<>::ptr> _waiting;
+  std::queue<Ivar<>::ptr> _waiting_push;
+
+  bool _closed = false;
+};
+
+} // namespace async
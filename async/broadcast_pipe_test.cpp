@@ -0,0 +1,91 @@
+#include "broadcast_pipe.hpp"
+
+#include <string>
+
+#include "testing.hpp"
+
+namespace async {
+namespace {
+
+using Policy = SlowSubscriberPolicy;
+
+Task<> drain(std::string name, BroadcastPipe<int>::Subscription::ptr sub)
+{
+  while (auto value = co_await sub->next_value()) {
+    P("$: $", name, *value);
+  }
+  P("$: done, dropped $", name, sub->dropped());
+}
+
+ASYNC_TEST(every_subscriber_reads)
+{
+  auto pipe = BroadcastPipe<std::string>::create(4, Policy::Drop);
+  auto sub1 = pipe->subscribe();
+  auto sub2 = pipe->subscribe();
+
+  pipe->push("hello");
+  auto v1 = co_await sub1->next_value();
+  auto v2 = co_await sub2->next_value();
+  P("values: $ $", *v1, *v2);
+}
+
+ASYNC_TEST(drop)
+{
+  auto pipe = BroadcastPipe<int>::create(3, Policy::Drop);
+  auto fast = drain("fast", pipe->subscribe());
+  auto slow_sub = pipe->subscribe();
+
+  for (int i = 0; i < 6; i++) {
+    P("push $: $", i, pipe->push(i));
+    co_await after(bee::Span::zero());
+  }
+  pipe->close();
+  P("slow dropped before reading: $", slow_sub->dropped());
+
+  co_await fast;
+  co_await drain("slow", slow_sub);
+}
+
+ASYNC_TEST(block)
+{
+  auto pipe = BroadcastPipe<int>::create(2, Policy::Block);
+  auto sub = pipe->subscribe();
+
+  P("push: $", pipe->push(0));
+  P("push: $", pipe->push(1));
+  P("push when full: $", pipe->push(2));
+
+  auto publisher = [&]() -> Task<> {
+    for (int i = 2; i < 5; i++) {
+      P("pushed $: $", i, co_await pipe->blocking_push(i));
+    }
+    pipe->close();
+  };
+  auto task = publisher();
+
+  co_await drain("sub", sub);
+  co_await task;
+}
+
+ASYNC_TEST(disconnect)
+{
+  auto pipe = BroadcastPipe<int>::create(2, Policy::Disconnect);
+  auto fast = drain("fast", pipe->subscribe());
+  auto slow = pipe->subscribe();
+
+  for (int i = 0; i < 4; i++) {
+    pipe->push(i);
+    co_await after(bee::Span::zero());
+  }
+  pipe->close();
+  co_await fast;
+  P("slow disconnected before reading: $", slow->is_disconnected());
+
+  auto value = co_await slow->next_value();
+  P("slow: has value $ disconnected $",
+    value.has_value(),
+    slow->is_disconnected());
+}
+
+} // namespace
+} // namespace async
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <cassert>
+#include <concepts>
+#include <coroutine>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "async.hpp"
+#include "trace.hpp"
+
+namespace async {
+
+// Bounded FIFO channel. send() suspends while the buffer is full and recv()
+// suspends while it is empty, so a slow consumer throttles its producers
+// instead of letting the buffer grow. A capacity of zero makes every send wait
+// for a matching recv.
+//
+// Waiters are the awaitables themselves, linked into intrusive lists while
+// their coroutine is suspended, so waiting doesn't allocate.
+template <class T> struct Channel {
+ private:
+  struct Waiter {
+    Waiter* next = nullptr;
+    std::coroutine_handle<> handle;
+    uint64_t trace_id = 0;
+
+    void suspend(std::coroutine_handle<> h)
+    {
+      handle = h;
+      trace_id = Tracer::current_task();
+      Tracer::task_suspended(trace_id);
+    }
+
+    void wake()
+    {
+      schedule([h = handle, trace_id = trace_id]() {
+        Tracer::task_resumed(trace_id);
+        h.resume();
+      });
+    }
+  };
+
+  template <class W> struct WaiterList {
+   public:
+    bool empty() const { return _head == nullptr; }
+
+    void push_back(W* waiter)
+    {
+      waiter->next = nullptr;
+      if (_tail == nullptr) {
+        _head = waiter;
+      } else {
+        _tail->next = waiter;
+      }
+      _tail = waiter;
+    }
+
+    W* pop_front()
+    {
+      W* waiter = _head;
+      _head = static_cast<W*>(waiter->next);
+      if (_head == nullptr) { _tail = nullptr; }
+      return waiter;
+    }
+
+   private:
+    W* _head = nullptr;
+    W* _tail = nullptr;
+  };
+
+ public:
+  using ptr = std::shared_ptr<Channel<T>>;
+
+  struct SendAwaitable : public Waiter {
+   public:
+    SendAwaitable(Channel* channel, T&& value)
+        : _channel(channel), _value(std::move(value))
+    {}
+
+    bool await_ready()
+    {
+      if (_channel->_closed) { return true; }
+      _sent = _channel->_try_send(*_value);
+      return _sent;
+    }
+
+    void await_suspend(std::coroutine_handle<> h)
+    {
+      this->suspend(h);
+      _channel->_senders.push_back(this);
+    }
+
+    // Returns false if the channel was closed before the value was accepted
+    bool await_resume() { return _sent; }
+
+   private:
+    friend Channel;
+
+    Channel* _channel;
+    std::optional<T> _value;
+    bool _sent = false;
+  };
+
+  struct RecvAwaitable : public Waiter {
+   public:
+    explicit RecvAwaitable(Channel* channel) : _channel(channel) {}
+
+    bool await_ready()
+    {
+      _value = _channel->_try_recv();
+      return _value.has_value() || _channel->_closed;
+    }
+
+    void await_suspend(std::coroutine_handle<> h)
+    {
+      this->suspend(h);
+      _channel->_receivers.push_back(this);
+    }
+
+    // Returns nullopt once the channel is closed and drained
+    std::optional<T> await_resume() { return std::move(_value); }
+
+   private:
+    friend Channel;
+
+    Channel* _channel;
+    std::optional<T> _value;
+  };
+
+  Channel(const Channel& other) = delete;
+  Channel(Channel&& other) = delete;
+
+  ~Channel() { close(); }
+
+  static ptr create(size_t capacity) { return ptr(new Channel<T>(capacity)); }
+
+  template <std::convertible_to<T> U> [[nodiscard]] SendAwaitable send(U&& v)
+  {
+    return SendAwaitable(this, T(std::forward<U>(v)));
+  }
+
+  [[nodiscard]] RecvAwaitable recv() { return RecvAwaitable(this); }
+
+  template <std::convertible_to<T> U> bool try_send(U&& v)
+  {
+    if (_closed) { return false; }
+    T value(std::forward<U>(v));
+    return _try_send(value);
+  }
+
+  std::optional<T> try_recv() { return _try_recv(); }
+
+  void close()
+  {
+    if (_closed) { return; }
+    _closed = true;
+    // Receivers only wait on an empty buffer, so nothing is lost here. Values
+    // from blocked senders are dropped.
+    while (!_receivers.empty()) { _receivers.pop_front()->wake(); }
+    while (!_senders.empty()) { _senders.pop_front()->wake(); }
+  }
+
+  bool is_closed() const { return _closed; }
+
+  size_t size() const { return _size; }
+
+  size_t capacity() const { return _ring.size(); }
+
+ private:
+  explicit Channel(size_t capacity) : _ring(capacity) {}
+
+  bool _try_send(T& value)
+  {
+    if (!_receivers.empty()) {
+      assert(_size == 0);
+      auto receiver = _receivers.pop_front();
+      receiver->_value.emplace(std::move(value));
+      receiver->wake();
+      return true;
+    }
+    if (_size == _ring.size()) { return false; }
+    _ring[(_head + _size) % _ring.size()].emplace(std::move(value));
+    _size++;
+    return true;
+  }
+
+  std::optional<T> _try_recv()
+  {
+    std::optional<T> output;
+    if (_size > 0) {
+      auto& slot = _ring[_head];
+      output.emplace(std::move(*slot));
+      slot.reset();
+      _head = (_head + 1) % _ring.size();
+      _size--;
+    }
+    if (!_senders.empty()) {
+      auto sender = _senders.pop_front();
+      if (output.has_value()) {
+        _ring[(_head + _size) % _ring.size()].emplace(
+          std::move(*sender->_value));
+        _size++;
+      } else {
+        output.emplace(std::move(*sender->_value));
+      }
+      sender->_sent = true;
+      sender->wake();
+    }
+    return output;
+  }
+
+  std::vector<std::optional<T>> _ring;
+  size_t _head = 0;
+  size_t _size = 0;
+
+  WaiterList<SendAwaitable> _senders;
+  WaiterList<RecvAwaitable> _receivers;
+
+  bool _closed = false;
+};
+
+} // namespace async
@@ -0,0 +1,82 @@
+#include "channel.hpp"
+#include "testing.hpp"
+
+#include "bee/format_optional.hpp"
+
+namespace async {
+namespace {
+
+ASYNC_TEST(basic)
+{
+  auto channel = Channel<int>::create(2);
+
+  auto produce = [&]() -> Task<> {
+    for (int i = 0; i < 5; i++) {
+      co_await channel->send(i);
+      P("sent $", i);
+    }
+    channel->close();
+  };
+  auto producer = produce();
+
+  while (auto value = co_await channel->recv()) { P("received $", *value); }
+
+  co_await producer;
+}
+
+ASYNC_TEST(try_send_when_full)
+{
+  auto channel = Channel<int>::create(2);
+  P("$", channel->try_send(1));
+  P("$", channel->try_send(2));
+  P("$", channel->try_send(3));
+  P("size: $", channel->size());
+  P("$", channel->try_recv());
+  P("$", channel->try_send(3));
+  channel->close();
+  while (auto value = co_await channel->recv()) { P("received $", *value); }
+}
+
+ASYNC_TEST(close_wakes_waiters)
+{
+  auto channel = Channel<int>::create(1);
+
+  auto receive = [&]() -> Task<> {
+    auto value = co_await channel->recv();
+    P("receiver got $", value);
+  };
+  auto receiver = receive();
+  channel->close();
+  co_await receiver;
+
+  auto full = Channel<int>::create(1);
+  P("$", full->try_send(1));
+  auto send = [&]() -> Task<> {
+    bool sent = co_await full->send(2);
+    P("sender got $", sent);
+  };
+  auto sender = send();
+  full->close();
+  co_await sender;
+  P("left in channel: $", full->try_recv());
+}
+
+ASYNC_TEST(rendezvous)
+{
+  auto channel = Channel<std::string>::create(0);
+
+  auto send = [&]() -> Task<> {
+    P("sending");
+    bool sent = co_await channel->send("hello");
+    P("sent: $", sent);
+  };
+  auto sender = send();
+
+  P("buffered: $", channel->size());
+  auto value = co_await channel->recv();
+  P("received $", value);
+  co_await sender;
+}
+
+} // namespace
+} // namespace async
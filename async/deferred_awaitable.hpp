@@ -5,6 +5,7 @@
 #include <type_traits>
 
 #include "async.hpp"
+#include "trace.hpp"
 
 #include "bee/copy.hpp"
 
@@ -26,7 +27,12 @@ template <deferable_value T> struct DeferredAwaitable {
 
   void await_suspend(std::coroutine_handle<> h)
   {
-    _deferred.iter([h](auto&&...) { h.resume(); });
+    uint64_t trace_id = Tracer::current_task();
+    Tracer::task_suspended(trace_id);
+    _deferred.iter([h, trace_id](auto&&...) {
+      Tracer::task_resumed(trace_id);
+      h.resume();
+    });
   }
 
   rvalue_type await_resume() { return std::move(_deferred).value(); }
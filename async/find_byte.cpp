@@ -0,0 +1,95 @@
+#include "find_byte.hpp"
+
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace async {
+
+const std::byte* find_byte_scalar(
+  const std::byte* begin, const std::byte* end, std::byte value)
+{
+  for (auto ptr = begin; ptr != end; ptr++) {
+    if (*ptr == value) { return ptr; }
+  }
+  return end;
+}
+
+#if defined(__x86_64__)
+
+namespace {
+
+// SSE2 is part of x86-64, no runtime check needed
+const std::byte* find_byte_sse2(
+  const std::byte* begin, const std::byte* end, std::byte value)
+{
+  const __m128i needle = _mm_set1_epi8(char(value));
+  auto ptr = begin;
+  for (; end - ptr >= 16; ptr += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+    if (mask != 0) { return ptr + __builtin_ctz(mask); }
+  }
+  return find_byte_scalar(ptr, end, value);
+}
+
+__attribute__((target("avx2"))) const std::byte* find_byte_avx2(
+  const std::byte* begin, const std::byte* end, std::byte value)
+{
+  const __m256i needle = _mm256_set1_epi8(char(value));
+  auto ptr = begin;
+  // Two vectors per iteration, most delimiters are more than 32 bytes apart
+  for (; end - ptr >= 64; ptr += 64) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+    __m256i b =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr + 32));
+    __m256i eq_a = _mm256_cmpeq_epi8(a, needle);
+    __m256i eq_b = _mm256_cmpeq_epi8(b, needle);
+    __m256i any = _mm256_or_si256(eq_a, eq_b);
+    if (_mm256_testz_si256(any, any)) { continue; }
+    uint32_t mask_a = uint32_t(_mm256_movemask_epi8(eq_a));
+    if (mask_a != 0) { return ptr + __builtin_ctz(mask_a); }
+    uint32_t mask_b = uint32_t(_mm256_movemask_epi8(eq_b));
+    return ptr + 32 + __builtin_ctz(mask_b);
+  }
+  for (; end - ptr >= 32; ptr += 32) {
+    __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+    uint32_t mask =
+      uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle)));
+    if (mask != 0) { return ptr + __builtin_ctz(mask); }
+  }
+  return find_byte_sse2(ptr, end, value);
+}
+
+using find_byte_fn = const std::byte* (*)(
+  const std::byte*, const std::byte*, std::byte);
+
+find_byte_fn select_find_byte()
+{
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) { return find_byte_avx2; }
+  return find_byte_sse2;
+}
+
+} // namespace
+
+const std::byte* find_byte(
+  const std::byte* begin, const std::byte* end, std::byte value)
+{
+  static const find_byte_fn impl = select_find_byte();
+  return impl(begin, end, value);
+}
+
+#else
+
+const std::byte* find_byte(
+  const std::byte* begin, const std::byte* end, std::byte value)
+{
+  return find_byte_scalar(begin, end, value);
+}
+
+#endif
+
+} // namespace async
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+
+namespace async {
+
+// Returns the first occurrence of value in [begin, end), or end. Uses AVX2
+// when the CPU supports it, SSE2 on other x86-64 CPUs and a scalar loop
+// elsewhere.
+const std::byte* find_byte(
+  const std::byte* begin, const std::byte* end, std::byte value);
+
+// The scalar version, exposed for tests and benchmarks
+const std::byte* find_byte_scalar(
+  const std::byte* begin, const std::byte* end, std::byte value);
+
+} // namespace async
@@ -0,0 +1,74 @@
+#include "io_thread_pool.hpp"
+
+#include <cassert>
+
+namespace async {
+
+IoThreadPool::IoThreadPool(
+  ThreadChannel<Job>::ptr&& jobs,
+  ThreadChannel<Job>::ptr&& completions,
+  size_t max_in_flight)
+    : _jobs(std::move(jobs)),
+      _completions(std::move(completions)),
+      _max_in_flight(max_in_flight)
+{}
+
+IoThreadPool::~IoThreadPool() { close(); }
+
+bee::OrError<IoThreadPool::ptr> IoThreadPool::create(
+  int num_threads, size_t max_in_flight)
+{
+  assert(num_threads > 0 && max_in_flight > 0);
+  bail(jobs, ThreadChannel<Job>::create(max_in_flight));
+  bail(completions, ThreadChannel<Job>::create(max_in_flight));
+  auto pool = ptr(new IoThreadPool(
+    std::move(jobs), std::move(completions), max_in_flight));
+  for (int i = 0; i < num_threads; i++) {
+    pool->_threads.emplace_back([jobs = pool->_jobs]() {
+      while (auto job = jobs->pop_blocking()) { job->fn(); }
+    });
+  }
+  schedule_task(_run_completions, pool->_completions);
+  return pool;
+}
+
+Task<> IoThreadPool::_run_completions(ThreadChannel<Job>::ptr completions)
+{
+  while (auto completion = co_await completions->next_value()) {
+    completion->fn();
+  }
+}
+
+void IoThreadPool::close()
+{
+  if (_jobs->is_closed()) { return; }
+  _jobs->close();
+  for (auto& thread : _threads) { thread.join(); }
+  _threads.clear();
+  // Every job has pushed its completion by now, they are still delivered
+  _completions->close();
+}
+
+Task<> IoThreadPool::_acquire_slot()
+{
+  if (_in_flight < _max_in_flight) {
+    _in_flight++;
+    co_return;
+  }
+  auto ivar = Ivar<>::create();
+  _slot_waiters.push_back(ivar);
+  co_await ivar;
+}
+
+void IoThreadPool::_release_slot()
+{
+  // The slot is handed over, _in_flight stays the same
+  if (!_slot_waiters.empty()) {
+    _slot_waiters.front()->fill();
+    _slot_waiters.pop_front();
+    return;
+  }
+  _in_flight--;
+}
+
+} // namespace async
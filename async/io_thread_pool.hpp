@@ -0,0 +1,94 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "async.hpp"
+#include "deferred_awaitable.hpp"
+#include "task.hpp"
+#include "thread_channel.hpp"
+
+#include "bee/error.hpp"
+
+namespace async {
+
+// Threads that run blocking calls, like disk I/O, off the scheduler thread.
+// Jobs go to the threads through a ThreadChannel and their results come back
+// through another one, so the caller resumes on the scheduler thread.
+//
+// At most max_in_flight jobs are queued or running, run() waits for a slot
+// beyond that, which also keeps both channels from ever filling up.
+//
+// create(), run() and the destructor must be called on the scheduler thread.
+// Pending runs keep the pool alive until their completions are delivered.
+struct IoThreadPool : public std::enable_shared_from_this<IoThreadPool> {
+ public:
+  using ptr = std::shared_ptr<IoThreadPool>;
+
+  IoThreadPool(const IoThreadPool&) = delete;
+  IoThreadPool(IoThreadPool&&) = delete;
+
+  ~IoThreadPool();
+
+  static bee::OrError<ptr> create(int num_threads, size_t max_in_flight = 256);
+
+  // Runs fn on a pool thread. fn must return a bee::OrError.
+  template <std::invocable F> Task<std::invoke_result_t<F>> run(F fn)
+  {
+    using R = std::invoke_result_t<F>;
+    auto self = shared_from_this();
+    co_await _acquire_slot();
+    auto ivar = Ivar<R>::create();
+    bool pushed = _jobs->push(
+      Job{[fn = std::move(fn), ivar, completions = _completions]() mutable {
+        completions->push(Job{[ivar, result = fn()]() mutable {
+          ivar->fill(std::move(result));
+        }});
+      }});
+    if (!pushed) {
+      _release_slot();
+      co_return bee::Error("IoThreadPool is closed");
+    }
+    R result = co_await ivar;
+    _release_slot();
+    co_return result;
+  }
+
+  // Lets queued jobs finish, blocking until they do, and stops the threads
+  void close();
+
+  int num_threads() const { return int(_threads.size()); }
+
+ private:
+  // Wrapped in a struct, a Task of an optional std::function would take the
+  // coroutine handle itself as its value
+  struct Job {
+    std::function<void()> fn;
+  };
+
+  IoThreadPool(
+    ThreadChannel<Job>::ptr&& jobs,
+    ThreadChannel<Job>::ptr&& completions,
+    size_t max_in_flight);
+
+  static Task<> _run_completions(ThreadChannel<Job>::ptr completions);
+
+  Task<> _acquire_slot();
+  void _release_slot();
+
+  ThreadChannel<Job>::ptr _jobs;
+  ThreadChannel<Job>::ptr _completions;
+  std::vector<std::thread> _threads;
+
+  size_t _max_in_flight;
+  size_t _in_flight = 0;
+  std::deque<Ivar<>::ptr> _slot_waiters;
+};
+
+} // namespace async
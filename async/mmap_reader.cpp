@@ -0,0 +1,141 @@
+#include "mmap_reader.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bee/fd.hpp"
+
+namespace async {
+
+struct MmapChunk::Mapping {
+  void* address;
+  size_t size;
+
+  ~Mapping() { munmap(address, size); }
+};
+
+namespace {
+
+size_t page_size()
+{
+  static const size_t size = sysconf(_SC_PAGESIZE);
+  return size;
+}
+
+size_t page_floor(size_t offset) { return offset - offset % page_size(); }
+
+size_t page_ceil(size_t offset) { return page_floor(offset + page_size() - 1); }
+
+} // namespace
+
+MmapReader::MmapReader(
+  std::shared_ptr<const MmapChunk::Mapping> mapping,
+  size_t size,
+  const Options& options)
+    : _mapping(std::move(mapping)),
+      _base(
+        _mapping == nullptr ? nullptr
+                            : static_cast<const std::byte*>(_mapping->address)),
+      _size(size),
+      _options(options)
+{}
+
+bee::OrError<MmapReader::ptr> MmapReader::open(const std::string& path)
+{
+  return open(path, Options());
+}
+
+bee::OrError<MmapReader::ptr> MmapReader::open(
+  const std::string& path, const Options& options)
+{
+  assert(options.chunk_size > 0);
+  int int_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (int_fd == -1) { shot("Failed to open '$': $", path, strerror(errno)); }
+  // The mapping stays valid after the fd is closed
+  bee::FD fd(int_fd);
+
+  struct stat st;
+  if (::fstat(fd.int_fd(), &st) == -1) {
+    shot("Failed to stat '$': $", path, strerror(errno));
+  }
+  size_t size = st.st_size;
+  if (size == 0) { return ptr(new MmapReader(nullptr, 0, options)); }
+
+  void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd.int_fd(), 0);
+  if (address == MAP_FAILED) {
+    shot("Failed to map '$': $", path, strerror(errno));
+  }
+  madvise(address, size, MADV_SEQUENTIAL);
+  std::shared_ptr<const MmapChunk::Mapping> mapping(
+    new MmapChunk::Mapping{.address = address, .size = size});
+  return ptr(new MmapReader(std::move(mapping), size, options));
+}
+
+std::optional<MmapChunk> MmapReader::next()
+{
+  if (_position >= _size) { return std::nullopt; }
+  _advise(_position);
+  size_t size = std::min(_options.chunk_size, _size - _position);
+  auto lease = std::make_shared<const MmapChunk::Lease>(_mapping);
+  if (_options.drop_behind) {
+    _handed_out.push_back(
+      HandedOut{.offset = _position, .size = size, .lease = lease});
+  }
+  MmapChunk chunk(std::move(lease), _base + _position, size, _position);
+  _position += size;
+  return chunk;
+}
+
+Task<> MmapReader::to_pipe(Pipe<MmapChunk>::ptr pipe)
+{
+  while (auto chunk = next()) {
+    if (pipe->is_closed()) { co_return; }
+    co_await pipe->blocking_push(std::move(*chunk));
+  }
+  pipe->close();
+}
+
+void MmapReader::_advise(size_t position)
+{
+  auto base = const_cast<std::byte*>(_base);
+
+  // Prefetching in half window steps keeps at least half a window of
+  // requests in flight without an madvise call per chunk
+  size_t window_end = std::min(position + _options.readahead, _size);
+  if (
+    window_end > _prefetched_until &&
+    (window_end >= _prefetched_until + _options.readahead / 2 ||
+     window_end == _size)) {
+    size_t start = page_floor(std::max(_prefetched_until, position));
+    madvise(base + start, window_end - start, MADV_WILLNEED);
+    _prefetched_until = window_end;
+  }
+
+  if (_options.drop_behind) {
+    size_t drop_end = page_floor(position);
+    if (drop_end < _dropped_until + _options.readahead) { return; }
+    std::erase_if(
+      _handed_out, [](const auto& chunk) { return chunk.lease.expired(); });
+    // Chunks may still be waiting in a pipe or held by the consumer, dropping
+    // their pages would make reading them fault on the scheduler thread
+    size_t start = _dropped_until;
+    for (const auto& chunk : _handed_out) {
+      size_t end = std::min(page_floor(chunk.offset), drop_end);
+      if (end > start) { madvise(base + start, end - start, MADV_DONTNEED); }
+      start = std::max(start, page_ceil(chunk.offset + chunk.size));
+    }
+    if (drop_end > start) {
+      madvise(base + start, drop_end - start, MADV_DONTNEED);
+    }
+    _dropped_until = drop_end;
+  }
+}
+
+} // namespace async
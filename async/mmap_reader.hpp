@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "pipe.hpp"
+#include "task.hpp"
+
+#include "bee/error.hpp"
+
+namespace async {
+
+struct MmapReader;
+
+// A view into a file mapped by MmapReader, which keeps the mapping alive
+struct MmapChunk {
+ public:
+  const std::byte* data() const { return _data; }
+  size_t size() const { return _size; }
+
+  // Offset of the chunk in the file
+  size_t offset() const { return _offset; }
+
+  std::string_view view() const
+  {
+    return std::string_view(reinterpret_cast<const char*>(_data), _size);
+  }
+
+ private:
+  friend MmapReader;
+
+  struct Mapping;
+
+  // Shared by the copies of a chunk, the reader watches it to know which
+  // pages are still in use
+  struct Lease {
+    std::shared_ptr<const Mapping> mapping;
+  };
+
+  MmapChunk(
+    std::shared_ptr<const Lease> lease,
+    const std::byte* data,
+    size_t size,
+    size_t offset)
+      : _lease(std::move(lease)), _data(data), _size(size), _offset(offset)
+  {}
+
+  std::shared_ptr<const Lease> _lease;
+  const std::byte* _data;
+  size_t _size;
+  size_t _offset;
+};
+
+// Reads a file sequentially through a read only mapping, handing out chunks
+// that point straight into it instead of copying with read(). The kernel is
+// told the access is sequential, the window ahead of the current position is
+// prefetched, and pages behind it are dropped from this mapping, except for
+// chunks still held anywhere, so scanning a large file doesn't pin it in
+// memory.
+//
+// Touching a page that isn't in the page cache yet blocks the thread, the
+// prefetch only makes that unlikely.
+struct MmapReader {
+ public:
+  using ptr = std::shared_ptr<MmapReader>;
+
+  struct Options {
+    size_t chunk_size = 1024 * 1024;
+    size_t readahead = 16 * 1024 * 1024;
+    bool drop_behind = true;
+  };
+
+  MmapReader(const MmapReader&) = delete;
+  MmapReader(MmapReader&&) = delete;
+
+  static bee::OrError<ptr> open(const std::string& path);
+  static bee::OrError<ptr> open(
+    const std::string& path, const Options& options);
+
+  // nullopt at the end of the file
+  std::optional<MmapChunk> next();
+
+  // Pushes every remaining chunk into pipe, waiting for it to be consumed,
+  // and closes the pipe at the end
+  Task<> to_pipe(Pipe<MmapChunk>::ptr pipe);
+
+  size_t size() const { return _size; }
+  size_t position() const { return _position; }
+
+  // Pages before this offset were dropped, unless a chunk on them is held
+  size_t dropped_until() const { return _dropped_until; }
+
+ private:
+  MmapReader(
+    std::shared_ptr<const MmapChunk::Mapping> mapping,
+    size_t size,
+    const Options& options);
+
+  void _advise(size_t position);
+
+  std::shared_ptr<const MmapChunk::Mapping> _mapping;
+  const std::byte* _base;
+  size_t _size;
+  Options _options;
+
+  size_t _position = 0;
+  size_t _prefetched_until = 0;
+  size_t _dropped_until = 0;
+
+  struct HandedOut {
+    size_t offset;
+    size_t size;
+    std::weak_ptr<const MmapChunk::Lease> lease;
+  };
+  // Chunks handed out that may still be alive, oldest first. Released ones are
+  // removed on every drop.
+  std::deque<HandedOut> _handed_out;
+};
+
+} // namespace async
@@ -0,0 +1,123 @@
+#include "mmap_reader.hpp"
+
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "record_splitter.hpp"
+#include "testing.hpp"
+
+#include "bee/fd.hpp"
+
+namespace async {
+namespace {
+
+std::string write_test_file(const std::string& name, const std::string& data)
+{
+  std::string path = F("/tmp/mmap_reader_test_$_$", name, getpid());
+  bee::FD fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+  must_unit(fd.write(data));
+  return path;
+}
+
+std::string numbered_lines(int count)
+{
+  std::string output;
+  for (int i = 0; i < count; i++) { output += F("line number $\n", i); }
+  return output;
+}
+
+MmapReader::Options small_windows()
+{
+  return MmapReader::Options{
+    .chunk_size = 4096,
+    .readahead = 16384,
+    .drop_behind = true,
+  };
+}
+
+ASYNC_TEST(split_records)
+{
+  auto content = numbered_lines(20000);
+  auto path = write_test_file("split", content);
+  must(reader, MmapReader::open(path, small_windows()));
+  unlink(path.c_str());
+  P("Size matches: $", reader->size() == content.size());
+
+  RecordSplitter splitter;
+  int lines = 0;
+  int mismatches = 0;
+  int chunks = 0;
+  while (auto chunk = reader->next()) {
+    chunks++;
+    must_unit(splitter.feed(chunk->view(), [&](std::string_view line) {
+      if (line != F("line number $", lines)) { mismatches++; }
+      lines++;
+    }));
+  }
+  P("Chunks: $", chunks == int((content.size() + 4095) / 4096));
+  P("Lines: $ mismatches: $", lines, mismatches);
+  P("Position at end: $", reader->position() == content.size());
+  co_return;
+}
+
+ASYNC_TEST(to_pipe)
+{
+  auto content = numbered_lines(5000);
+  auto path = write_test_file("pipe", content);
+  must(reader, MmapReader::open(path, small_windows()));
+  unlink(path.c_str());
+
+  auto pipe = Pipe<MmapChunk>::create();
+  auto producer = reader->to_pipe(pipe);
+
+  std::string received;
+  size_t expected_offset = 0;
+  bool offsets_match = true;
+  while (auto chunk = co_await pipe->next_value()) {
+    offsets_match &= chunk->offset() == expected_offset;
+    expected_offset += chunk->size();
+    received += chunk->view();
+  }
+  co_await producer;
+  P("Content matches: $", received == content);
+  P("Offsets match: $", offsets_match);
+}
+
+ASYNC_TEST(held_chunks_are_skipped)
+{
+  auto content = numbered_lines(20000);
+  auto path = write_test_file("held", content);
+  must(reader, MmapReader::open(path, small_windows()));
+  unlink(path.c_str());
+
+  // Chunks that are released right away are dropped behind the reader
+  for (int i = 0; i < 20; i++) { reader->next(); }
+  P("Dropped released chunks: $", reader->dropped_until() > 0);
+
+  // One early chunk held while the rest of the file is read doesn't stop
+  // dropping the pages after it
+  auto held = *reader->next();
+  while (reader->next()) {}
+  P("Dropped past the held chunk: $",
+    reader->dropped_until() > held.offset() + held.size());
+  P("Held chunk intact: $",
+    held.view() == std::string_view(content).substr(held.offset(), 4096));
+  co_return;
+}
+
+ASYNC_TEST(empty_and_missing)
+{
+  auto path = write_test_file("empty", "");
+  must(reader, MmapReader::open(path));
+  unlink(path.c_str());
+  P("Empty: $", !reader->next().has_value());
+
+  auto missing = MmapReader::open("/nonexistent/mmap_reader_test");
+  P("Missing: $", missing.is_error());
+  co_return;
+}
+
+} // namespace
+} // namespace async
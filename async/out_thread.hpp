@@ -6,6 +6,7 @@
 #include "once.hpp"
 #include "pipe.hpp"
 #include "queue_bridge.hpp"
+#include "thread_channel.hpp"
 
 #include "bee/queue.hpp"
 
@@ -20,20 +21,29 @@ struct OutThread {
 
     void send(Out&& value) { output_queue.push(std::move(value)); }
 
-    QueuePair(bee::Pipe&& data_pipe) : output_queue(std::move(data_pipe)) {}
+    QueuePair(typename ThreadChannel<Out>::ptr channel)
+        : output_queue(std::move(channel))
+    {}
 
     QueuePair(const QueuePair& other) = delete;
     QueuePair(QueuePair&& other) = default;
   };
 
   using ptr = std::shared_ptr<OutThread>;
+
+  // Outputs that can be waiting to be moved to output_pipe() before the
+  // threads block
+  static constexpr size_t output_capacity = 1024;
   using ThreadFunction = std::function<void(QueuePair& queue_pair)>;
 
   OutThread(const OutThread& other) = delete;
   OutThread(OutThread&& other) = delete;
 
-  OutThread(ThreadFunction&& fn, bee::Pipe&& data_pipe, int num_threads)
-      : _queue_pair(std::move(data_pipe))
+  OutThread(
+    ThreadFunction&& fn,
+    typename ThreadChannel<Out>::ptr channel,
+    int num_threads)
+      : _queue_pair(std::move(channel))
   {
     if (num_threads > 1) {
       std::vector<std::thread> worker_threads;
@@ -67,9 +77,9 @@ struct OutThread {
 
   static bee::OrError<ptr> create(ThreadFunction&& fn, int num_threads)
   {
-    bail(data_pipe, bee::Pipe::create());
+    bail(channel, ThreadChannel<Out>::create(output_capacity));
     return std::make_shared<OutThread>(
-      std::move(fn), std::move(data_pipe), num_threads);
+      std::move(fn), std::move(channel), num_threads);
   }
 
   void close()
@@ -77,8 +87,10 @@ struct OutThread {
     if (_closed) return;
     _closed = true;
     _queue_pair.input_queue.close();
+    // The threads may be waiting for room in the output channel, so it's
+    // drained until they are done instead of just joining them
+    _queue_pair.output_queue.drain_until_write_closed();
     _maybe_join();
-    _queue_pair.output_queue.close();
   }
 
  private:
@@ -35,6 +35,20 @@ ASYNC_TEST(basic)
   co_await print_task;
 }
 
+ASYNC_TEST(more_outputs_than_capacity)
+{
+  must(out_thread, (OutThread<int, int>::create(out_thread_runner, 2)));
+
+  // Nothing is received until close, so the threads fill the output channel
+  int count = OutThread<int, int>::output_capacity * 3;
+  for (int i = 0; i < count; i++) { out_thread->send(1); }
+  out_thread->close();
+
+  int received = 0;
+  while (auto value = co_await out_thread->receive()) { received += *value; }
+  P("received: $", received);
+}
+
 ASYNC_TEST(dont_close)
 {
   must(ot, (OutThread<int, int>::create(out_thread_runner, 1)));
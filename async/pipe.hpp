@@ -2,18 +2,32 @@
 
 #include <cassert>
 #include <concepts>
+#include <deque>
 #include <memory>
 #include <optional>
 #include <queue>
+#include <vector>
 
 #include "async.hpp"
 #include "deferred_awaitable.hpp"
 #include "task.hpp"
 
 #include "bee/format.hpp"
+#include "bee/span.hpp"
+#include "bee/time.hpp"
 
 namespace async {
 
+template <class T> struct Pipe;
+
+namespace details {
+
+template <class T> struct BatchWindowStage;
+template <class T> struct DebounceStage;
+template <class T> struct ThrottleStage;
+
+} // namespace details
+
 template <class T> struct Pipe : public std::enable_shared_from_this<Pipe<T>> {
  public:
   using ptr = std::shared_ptr<Pipe<T>>;
@@ -31,6 +45,7 @@ template <class T> struct Pipe : public std::enable_shared_from_this<Pipe<T>> {
 
     if (_waiting_pop.empty()) {
       _queue.push(std::forward<U>(v));
+      _notify_ready();
     } else {
       _waiting_pop.front()->fill(std::forward<U>(v));
       _waiting_pop.pop();
@@ -66,16 +81,52 @@ template <class T> struct Pipe : public std::enable_shared_from_this<Pipe<T>> {
     } else if (_closed) {
       co_return std::nullopt;
     } else {
-      auto ivar = Ivar<std::optional<T>>::create();
-      _waiting_pop.push(ivar);
+      co_return co_await _wait_value();
+    }
+  }
 
-      if (!_waiting_push.empty()) {
-        _waiting_push.front()->fill();
-        _waiting_push.pop();
-      }
+  // Takes a value only if one is already queued
+  std::optional<T> try_next()
+  {
+    if (_queue.empty()) { return std::nullopt; }
+    auto ret = std::move(_queue.front());
+    _queue.pop();
+    return ret;
+  }
 
-      co_return co_await ivar;
+  // Determined once a value is queued or the pipe is closed, without taking
+  // the value. The pipe only keeps a weak reference to the returned deferred,
+  // so waiters that are dropped before that don't accumulate.
+  Deferred<> ready()
+  {
+    if (!_queue.empty() || _closed) { return {}; }
+    std::erase_if(
+      _waiting_ready, [](const auto& weak) { return weak.expired(); });
+    auto ivar = Ivar<>::create();
+    _waiting_ready.push_back(ivar);
+    return ivar;
+  }
+
+  // Appends up to max_items values to output, waiting only if none are
+  // available. Returns the number of values appended, zero means the pipe is
+  // closed.
+  Task<size_t> next_batch(std::vector<T>& output, size_t max_items)
+  {
+    assert(max_items > 0);
+    size_t count = 0;
+    if (_queue.empty()) {
+      if (_closed) { co_return 0; }
+      auto first = co_await _wait_value();
+      if (!first.has_value()) { co_return 0; }
+      output.push_back(std::move(*first));
+      count++;
+    }
+    while (count < max_items && !_queue.empty()) {
+      output.push_back(std::move(_queue.front()));
+      _queue.pop();
+      count++;
     }
+    co_return count;
   }
 
   template <std::invocable<T> F> Task<> iter(F&& f)
@@ -88,6 +139,15 @@ template <class T> struct Pipe : public std::enable_shared_from_this<Pipe<T>> {
     return _iter2(this->shared_from_this(), std::forward<F>(f));
   }
 
+  // f is called with a vector of up to max_items values, the vector is reused
+  // between calls
+  template <std::invocable<std::vector<T>&> F>
+  Task<> iter_batches(size_t max_items, F&& f)
+  {
+    return _iter_batches(
+      this->shared_from_this(), max_items, std::forward<F>(f));
+  }
+
   template <typename R, std::invocable<T> F> typename Pipe<R>::ptr map(F&& f)
   {
     auto out_pipe = Pipe<R>::create();
@@ -103,6 +163,52 @@ template <class T> struct Pipe : public std::enable_shared_from_this<Pipe<T>> {
     return out_pipe;
   }
 
+  // Like map, but f returns a Task and up to max_concurrency of them run at
+  // the same time. Results are pushed in input order, a slow value holds back
+  // the ones after it but still counts against max_concurrency.
+  template <
+    std::invocable<T> F,
+    class R = typename std::invoke_result_t<F&, T&&>::value_type>
+    requires task<std::invoke_result_t<F&, T&&>> && (!std::is_void_v<R>)
+  typename Pipe<R>::ptr map_concurrent(size_t max_concurrency, F&& f)
+  {
+    assert(max_concurrency > 0);
+    auto out_pipe = Pipe<R>::create();
+    async::schedule_task(
+      _map_concurrent<R, std::decay_t<F>>,
+      this->shared_from_this(),
+      out_pipe,
+      max_concurrency,
+      std::decay_t<F>(std::forward<F>(f)));
+    return out_pipe;
+  }
+
+  // Emits batches of up to max_items values, a batch that isn't full is
+  // emitted max_delay after its first value arrived
+  std::shared_ptr<Pipe<std::vector<T>>> batch_window(
+    size_t max_items, bee::Span max_delay)
+  {
+    assert(max_items > 0);
+    return _run_timed_stage(std::make_shared<details::BatchWindowStage<T>>(
+      max_items, max_delay));
+  }
+
+  // Emits a value once no other value has arrived for span, values that are
+  // followed by another one within span are dropped
+  ptr debounce(bee::Span span)
+  {
+    return _run_timed_stage(std::make_shared<details::DebounceStage<T>>(span));
+  }
+
+  // Emits at most one value per interval. The first value is emitted right
+  // away, and the latest value that arrived during the interval is emitted
+  // when it ends, or as soon as the source closes. Other values are dropped.
+  ptr throttle(bee::Span interval)
+  {
+    return _run_timed_stage(
+      std::make_shared<details::ThrottleStage<T>>(interval));
+  }
+
   void close()
   {
     if (_closed) return;
@@ -115,6 +221,7 @@ template <class T> struct Pipe : public std::enable_shared_from_this<Pipe<T>> {
       _waiting_push.front()->fill();
       _waiting_push.pop();
     }
+    _notify_ready();
   }
 
   bool is_closed() const { return _closed; }
@@ -142,11 +249,311 @@ template <class T> struct Pipe : public std::enable_shared_from_this<Pipe<T>> {
     }
   }
 
+  template <std::invocable<std::vector<T>&> F>
+  static Task<> _iter_batches(
+    std::weak_ptr<Pipe> weak_ptr, size_t max_items, F f)
+  {
+    std::vector<T> batch;
+    batch.reserve(max_items);
+    while (auto ptr = weak_ptr.lock()) {
+      auto count = co_await ptr->next_batch(batch, max_items);
+      if (count == 0) { break; }
+      f(batch);
+      batch.clear();
+    }
+  }
+
+  // Reorder buffer shared by map_concurrent and its in-flight calls. Slot i
+  // holds the result for input number first_seq + i once it is done.
+  template <class R> struct ReorderWindow {
+    typename Pipe<R>::ptr out_pipe;
+    std::deque<std::optional<R>> slots;
+    uint64_t first_seq = 0;
+    typename Ivar<>::ptr slot_freed;
+
+    void complete(uint64_t seq, R&& value)
+    {
+      slots[seq - first_seq].emplace(std::move(value));
+      bool freed = false;
+      while (!slots.empty() && slots.front().has_value()) {
+        if (!out_pipe->is_closed()) {
+          out_pipe->push(std::move(*slots.front()));
+        }
+        slots.pop_front();
+        first_seq++;
+        freed = true;
+      }
+      if (freed && slot_freed != nullptr) {
+        auto ivar = std::move(slot_freed);
+        slot_freed = nullptr;
+        ivar->fill();
+      }
+    }
+
+    Task<> wait_slot_freed()
+    {
+      slot_freed = Ivar<>::create();
+      co_await slot_freed;
+    }
+  };
+
+  template <class R, class F>
+  static Task<> _map_concurrent(
+    ptr source,
+    typename Pipe<R>::ptr out_pipe,
+    size_t max_concurrency,
+    F f)
+  {
+    auto window = std::make_shared<ReorderWindow<R>>();
+    window->out_pipe = out_pipe;
+    while (true) {
+      while (window->slots.size() >= max_concurrency) {
+        co_await window->wait_slot_freed();
+      }
+      auto value = co_await source->next_value();
+      if (!value.has_value() || out_pipe->is_closed()) { break; }
+      uint64_t seq = window->first_seq + window->slots.size();
+      window->slots.emplace_back();
+      _complete_into(window, seq, f(std::move(*value)));
+    }
+    while (!window->slots.empty()) { co_await window->wait_slot_freed(); }
+    out_pipe->close();
+  }
+
+  template <class R>
+  static Task<> _complete_into(
+    std::shared_ptr<ReorderWindow<R>> window, uint64_t seq, Task<R> task)
+  {
+    window->complete(seq, co_await task);
+  }
+
+  template <class S>
+  typename S::out_pipe_type _run_timed_stage(std::shared_ptr<S> stage)
+  {
+    async::schedule_task(
+      _drive_timed_stage<S>, this->shared_from_this(), stage);
+    return stage->out_pipe;
+  }
+
+  template <class S>
+  static Task<> _drive_timed_stage(ptr source, std::shared_ptr<S> stage)
+  {
+    while (true) {
+      auto value = co_await source->next_value();
+      if (!value.has_value() || stage->out_pipe->is_closed()) { break; }
+      stage->on_value(std::move(*value));
+    }
+    stage->on_close();
+  }
+
+  void _notify_ready()
+  {
+    if (_waiting_ready.empty()) { return; }
+    auto waiting = std::move(_waiting_ready);
+    _waiting_ready.clear();
+    for (auto& weak : waiting) {
+      if (auto ivar = weak.lock()) { ivar->fill(); }
+    }
+  }
+
+  Task<std::optional<T>> _wait_value()
+  {
+    auto ivar = Ivar<std::optional<T>>::create();
+    _waiting_pop.push(ivar);
+
+    if (!_waiting_push.empty()) {
+      _waiting_push.front()->fill();
+      _waiting_push.pop();
+    }
+
+    co_return co_await ivar;
+  }
+
   std::queue<T> _queue;
   std::queue<typename Ivar<std::optional<T>>::ptr> _waiting_pop;
   std::queue<typename Ivar<>::ptr> _waiting_push;
+  std::vector<std::weak_ptr<Ivar<>>> _waiting_ready;
 
   bool _closed = false;
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// Time-window stages
+//
+// Each stage is fed by a consumer loop on the source pipe and owns at most one
+// pending timer, which keeps the stage alive so a tail can still be emitted
+// after the source closes. Not every scheduler can cancel timers, so a timer
+// that fires after it was superseded is ignored by checking its generation.
+//
+
+namespace details {
+
+template <class Self, class Out>
+struct TimedStage : public std::enable_shared_from_this<Self> {
+ public:
+  using out_pipe_type = std::shared_ptr<Pipe<Out>>;
+
+  out_pipe_type out_pipe = Pipe<Out>::create();
+
+ protected:
+  void arm_timer(bee::Span span)
+  {
+    disarm_timer();
+    _timer_armed = true;
+    _timer_id = async::after(
+      span, [self = this->shared_from_this(), generation = _generation]() {
+        if (self->_generation != generation) { return; }
+        self->_timer_armed = false;
+        self->_generation++;
+        self->on_timer();
+      });
+  }
+
+  void disarm_timer()
+  {
+    if (!_timer_armed) { return; }
+    _timer_armed = false;
+    _generation++;
+    async::cancel(_timer_id);
+  }
+
+  bool timer_armed() const { return _timer_armed; }
+
+  template <class U> void emit(U&& value)
+  {
+    if (!out_pipe->is_closed()) { out_pipe->push(std::forward<U>(value)); }
+  }
+
+ private:
+  bool _timer_armed = false;
+  uint64_t _generation = 0;
+  TimedTaskId _timer_id{0};
+};
+
+template <class T>
+struct BatchWindowStage
+    : public TimedStage<BatchWindowStage<T>, std::vector<T>> {
+ public:
+  BatchWindowStage(size_t max_items, bee::Span max_delay)
+      : _max_items(max_items), _max_delay(max_delay)
+  {}
+
+  void on_value(T&& value)
+  {
+    if (_batch.empty()) { this->arm_timer(_max_delay); }
+    _batch.push_back(std::move(value));
+    if (_batch.size() >= _max_items) {
+      this->disarm_timer();
+      _flush();
+    }
+  }
+
+  void on_timer() { _flush(); }
+
+  void on_close()
+  {
+    this->disarm_timer();
+    _flush();
+    this->out_pipe->close();
+  }
+
+ private:
+  void _flush()
+  {
+    if (_batch.empty()) { return; }
+    this->emit(std::move(_batch));
+    _batch = {};
+  }
+
+  size_t _max_items;
+  bee::Span _max_delay;
+  std::vector<T> _batch;
+};
+
+template <class T>
+struct DebounceStage : public TimedStage<DebounceStage<T>, T> {
+ public:
+  explicit DebounceStage(bee::Span span) : _span(span) {}
+
+  // Rather than re-arming the timer on every value, only the deadline moves
+  // and the timer re-arms itself for the remainder when it fires early
+  void on_value(T&& value)
+  {
+    _pending.emplace(std::move(value));
+    _deadline = bee::Time::monotonic() + _span;
+    if (!this->timer_armed()) { this->arm_timer(_span); }
+  }
+
+  void on_timer()
+  {
+    auto now = bee::Time::monotonic();
+    if (now < _deadline) {
+      this->arm_timer(_deadline - now);
+      return;
+    }
+    _flush();
+  }
+
+  void on_close()
+  {
+    this->disarm_timer();
+    _flush();
+    this->out_pipe->close();
+  }
+
+ private:
+  void _flush()
+  {
+    if (!_pending.has_value()) { return; }
+    this->emit(std::move(*_pending));
+    _pending.reset();
+  }
+
+  bee::Span _span;
+  std::optional<T> _pending;
+  bee::Time _deadline = bee::Time::zero();
+};
+
+template <class T>
+struct ThrottleStage : public TimedStage<ThrottleStage<T>, T> {
+ public:
+  explicit ThrottleStage(bee::Span interval) : _interval(interval) {}
+
+  void on_value(T&& value)
+  {
+    if (this->timer_armed()) {
+      _pending.emplace(std::move(value));
+    } else {
+      this->emit(std::move(value));
+      this->arm_timer(_interval);
+    }
+  }
+
+  void on_timer()
+  {
+    if (!_pending.has_value()) { return; }
+    this->emit(std::move(*_pending));
+    _pending.reset();
+    this->arm_timer(_interval);
+  }
+
+  // Like the other stages, a pending value is flushed right away rather than
+  // at the end of the current interval
+  void on_close()
+  {
+    this->disarm_timer();
+    if (_pending.has_value()) {
+      this->emit(std::move(*_pending));
+      _pending.reset();
+    }
+    this->out_pipe->close();
+  }
+
+ private:
+  bee::Span _interval;
+  std::optional<T> _pending;
+};
+
+} // namespace details
+
 } // namespace async
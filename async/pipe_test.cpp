@@ -1,4 +1,7 @@
 #include "pipe.hpp"
+
+#include <algorithm>
+
 #include "testing.hpp"
 
 namespace async {
@@ -42,5 +45,137 @@ ASYNC_TEST(destroy_while_iterating)
   co_return;
 }
 
+ASYNC_TEST(next_batch)
+{
+  auto pipe = Pipe<int>::create();
+  for (int i = 0; i < 5; i++) { pipe->push(i); }
+
+  std::vector<int> batch;
+  P("count: $", co_await pipe->next_batch(batch, 3));
+  P("count: $", co_await pipe->next_batch(batch, 3));
+  for (int v : batch) { P(v); }
+
+  auto push_later = [&]() -> Task<> {
+    co_await after(bee::Span::of_millis(1));
+    pipe->push(10);
+    pipe->push(11);
+    pipe->close();
+  };
+  auto pusher = push_later();
+
+  batch.clear();
+  P("count: $", co_await pipe->next_batch(batch, 10));
+  for (int v : batch) { P(v); }
+  P("count: $", co_await pipe->next_batch(batch, 10));
+
+  co_await pusher;
+}
+
+ASYNC_TEST(iter_batches)
+{
+  auto pipe = Pipe<int>::create();
+
+  auto task = schedule_task([&]() {
+    return pipe->iter_batches(2, [](std::vector<int>& batch) {
+      P("batch of $", batch.size());
+      for (int v : batch) { P(v); }
+    });
+  });
+
+  for (int i = 0; i < 5; i++) { pipe->push(i); }
+  pipe->close();
+
+  co_await task;
+}
+
+ASYNC_TEST(map_concurrent)
+{
+  auto pipe = Pipe<int>::create();
+
+  int running = 0;
+  int max_running = 0;
+  auto lookup = [&](int v) -> Task<int> {
+    running++;
+    max_running = std::max(max_running, running);
+    // Later values finish first
+    co_await after(bee::Span::of_millis(10 - v));
+    running--;
+    co_return v * 10;
+  };
+
+  auto out = pipe->map_concurrent(3, lookup);
+  auto task = schedule_task([&]() { return out->iter([](int v) { P(v); }); });
+
+  for (int i = 0; i < 7; i++) { pipe->push(i); }
+  pipe->close();
+
+  co_await task;
+  P("max running: $", max_running);
+  P("closed: $", out->is_closed());
+}
+
+ASYNC_TEST(batch_window)
+{
+  auto pipe = Pipe<int>::create();
+
+  auto out = pipe->batch_window(3, bee::Span::of_millis(20));
+  auto print_batch = [](const std::vector<int>& batch) {
+    P("batch of $", batch.size());
+    for (int v : batch) { P(v); }
+  };
+
+  for (int i = 0; i < 7; i++) { pipe->push(i); }
+  // The last batch isn't full, so it's emitted once the delay expires
+  for (int i = 0; i < 3; i++) { print_batch(*(co_await out->next_value())); }
+  pipe->push(7);
+  pipe->close();
+
+  while (auto batch = co_await out->next_value()) { print_batch(*batch); }
+  P("closed: $", out->is_closed());
+}
+
+ASYNC_TEST(debounce)
+{
+  auto pipe = Pipe<int>::create();
+
+  auto out = pipe->debounce(bee::Span::of_millis(20));
+
+  for (int i = 0; i < 3; i++) { pipe->push(i); }
+  P(*(co_await out->next_value()));
+  pipe->push(3);
+  pipe->push(4);
+  pipe->close();
+
+  while (auto value = co_await out->next_value()) { P(*value); }
+  P("closed: $", out->is_closed());
+}
+
+ASYNC_TEST(throttle)
+{
+  auto pipe = Pipe<int>::create();
+
+  auto interval = bee::Span::of_millis(200);
+  auto out = pipe->throttle(interval);
+
+  auto start = bee::Time::monotonic();
+  pipe->push(0);
+  pipe->push(1);
+  pipe->push(2);
+  P(*(co_await out->next_value()));
+  P(*(co_await out->next_value()));
+  auto second_at = bee::Time::monotonic();
+  P("held for the interval: $", second_at - start >= interval);
+
+  // The pending value is flushed as soon as the source closes
+  pipe->push(3);
+  pipe->push(4);
+  pipe->close();
+
+  while (auto value = co_await out->next_value()) { P(*value); }
+  P("closed: $", out->is_closed());
+  auto elapsed = bee::Time::monotonic() - second_at;
+  P("closed within the interval: $", elapsed < interval);
+}
+
 } // namespace
 } // namespace async
@@ -0,0 +1,309 @@
+#pragma once
+
+#include <cassert>
+#include <concepts>
+#include <memory>
+#include <ranges>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "pipe.hpp"
+#include "task.hpp"
+
+namespace async {
+
+////////////////////////////////////////////////////////////////////////////////
+// Stages
+//
+// A stage is a description of a transformation. Once the input type is known
+// it is turned into a bound stage, which pushes its outputs straight into the
+// next bound stage, so a whole chain runs inside a single consumer loop.
+//
+
+namespace ops {
+
+struct Stage {};
+
+template <class F> struct Map : public Stage {
+  explicit Map(F&& f) : f(std::move(f)) {}
+
+  F f;
+
+  template <class In> struct bound {
+    using output_type = std::decay_t<std::invoke_result_t<F&, In&&>>;
+
+    explicit bound(const Map& stage) : f(stage.f) {}
+
+    // f may return a reference into value, which doesn't outlive the call
+    template <class Next> void push(In&& value, Next& next)
+    {
+      next.push(output_type(f(std::move(value))));
+    }
+
+    template <class Next> void flush(Next&) {}
+
+    F f;
+  };
+};
+
+template <class F> struct Filter : public Stage {
+  explicit Filter(F&& f) : f(std::move(f)) {}
+
+  F f;
+
+  template <class In> struct bound {
+    using output_type = In;
+
+    explicit bound(const Filter& stage) : f(stage.f) {}
+
+    template <class Next> void push(In&& value, Next& next)
+    {
+      if (f(std::as_const(value))) { next.push(std::move(value)); }
+    }
+
+    template <class Next> void flush(Next&) {}
+
+    F f;
+  };
+};
+
+template <class F> struct FlatMap : public Stage {
+  explicit FlatMap(F&& f) : f(std::move(f)) {}
+
+  F f;
+
+  template <class In> struct bound {
+    using range_type = std::invoke_result_t<F&, In&&>;
+    using output_type = std::ranges::range_value_t<range_type>;
+
+    explicit bound(const FlatMap& stage) : f(stage.f) {}
+
+    template <class Next> void push(In&& value, Next& next)
+    {
+      for (auto&& out : f(std::move(value))) { next.push(std::move(out)); }
+    }
+
+    template <class Next> void flush(Next&) {}
+
+    F f;
+  };
+};
+
+struct Batch : public Stage {
+  explicit Batch(size_t size) : size(size) {}
+
+  size_t size;
+
+  template <class In> struct bound {
+    using output_type = std::vector<In>;
+
+    explicit bound(const Batch& stage) : size(stage.size)
+    {
+      current.reserve(size);
+    }
+
+    template <class Next> void push(In&& value, Next& next)
+    {
+      current.push_back(std::move(value));
+      if (current.size() >= size) {
+        next.push(std::move(current));
+        current = {};
+        current.reserve(size);
+      }
+    }
+
+    template <class Next> void flush(Next& next)
+    {
+      if (!current.empty()) { next.push(std::move(current)); }
+    }
+
+    size_t size;
+    std::vector<In> current;
+  };
+};
+
+template <class F> Map<std::decay_t<F>> map(F f)
+{
+  return Map<std::decay_t<F>>(std::move(f));
+}
+
+template <class F> Filter<std::decay_t<F>> filter(F f)
+{
+  return Filter<std::decay_t<F>>(std::move(f));
+}
+
+template <class F> FlatMap<std::decay_t<F>> flat_map(F f)
+{
+  return FlatMap<std::decay_t<F>>(std::move(f));
+}
+
+inline Batch batch(size_t size)
+{
+  assert(size > 0);
+  return Batch(size);
+}
+
+} // namespace ops
+
+template <class S>
+concept pipeline_stage = std::derived_from<std::decay_t<S>, ops::Stage>;
+
+namespace details {
+
+template <class Sink, class In, class... Stages> struct StageChain;
+
+template <class Sink, class In> struct StageChain<Sink, In> {
+ public:
+  using output_type = In;
+
+  explicit StageChain(Sink&& sink) : _sink(std::move(sink)) {}
+
+  void push(In&& value) { _sink(std::move(value)); }
+  void flush() {}
+
+ private:
+  Sink _sink;
+};
+
+template <class Sink, class In, class S, class... Rest>
+struct StageChain<Sink, In, S, Rest...> {
+ private:
+  using stage_type = typename S::template bound<In>;
+  using next_type =
+    StageChain<Sink, typename stage_type::output_type, Rest...>;
+
+ public:
+  using output_type = typename next_type::output_type;
+
+  StageChain(Sink&& sink, const S& stage, const Rest&... rest)
+      : _stage(stage), _next(std::move(sink), rest...)
+  {}
+
+  void push(In&& value) { _stage.push(std::move(value), _next); }
+
+  void flush()
+  {
+    _stage.flush(_next);
+    _next.flush();
+  }
+
+ private:
+  stage_type _stage;
+  next_type _next;
+};
+
+struct NoSink {
+  template <class T> void operator()(T&&) {}
+};
+
+} // namespace details
+
+////////////////////////////////////////////////////////////////////////////////
+// Pipeline
+//
+// Built with `pipe | ops::map(f) | ops::filter(g) | ops::batch(n)`. Nothing
+// runs until iter() or to_pipe() is called, at which point the source pipe is
+// drained by one coroutine that runs every stage, with no intermediate pipes.
+//
+
+template <class T, pipeline_stage... Stages> struct Pipeline {
+ public:
+  using output_type = typename details::
+    StageChain<details::NoSink, T, Stages...>::output_type;
+
+  Pipeline(typename Pipe<T>::ptr source, std::tuple<Stages...>&& stages)
+      : _source(std::move(source)), _stages(std::move(stages))
+  {}
+
+  template <pipeline_stage S>
+  Pipeline<T, Stages..., std::decay_t<S>> then(S&& stage) &&
+  {
+    return Pipeline<T, Stages..., std::decay_t<S>>(
+      std::move(_source),
+      std::tuple_cat(
+        std::move(_stages), std::make_tuple(std::forward<S>(stage))));
+  }
+
+  template <std::invocable<output_type> F> Task<> iter(F&& f) &&
+  {
+    return _iter(std::weak_ptr<Pipe<T>>(_source), _make_chain(std::move(f)));
+  }
+
+  typename Pipe<output_type>::ptr to_pipe() &&
+  {
+    auto out_pipe = Pipe<output_type>::create();
+    auto chain = _make_chain([out_pipe](output_type&& value) {
+      if (!out_pipe->is_closed()) { out_pipe->push(std::move(value)); }
+    });
+    async::schedule_task(
+      _forward<decltype(chain)>,
+      std::move(_source),
+      out_pipe,
+      std::move(chain));
+    return out_pipe;
+  }
+
+ private:
+  // Number of values taken from the source per resumption
+  static constexpr size_t max_batch = 64;
+
+  template <class Sink> auto _make_chain(Sink&& sink)
+  {
+    return std::apply(
+      [&](const Stages&... stages) {
+        return details::StageChain<std::decay_t<Sink>, T, Stages...>(
+          std::forward<Sink>(sink), stages...);
+      },
+      _stages);
+  }
+
+  template <class Chain>
+  static Task<> _iter(std::weak_ptr<Pipe<T>> weak_ptr, Chain chain)
+  {
+    std::vector<T> values;
+    while (auto ptr = weak_ptr.lock()) {
+      if (co_await ptr->next_batch(values, max_batch) == 0) { break; }
+      for (auto& value : values) { chain.push(std::move(value)); }
+      values.clear();
+    }
+    chain.flush();
+  }
+
+  template <class Chain>
+  static Task<> _forward(
+    typename Pipe<T>::ptr source,
+    typename Pipe<output_type>::ptr out_pipe,
+    Chain chain)
+  {
+    std::vector<T> values;
+    while (!out_pipe->is_closed()) {
+      if (co_await source->next_batch(values, max_batch) == 0) { break; }
+      for (auto& value : values) { chain.push(std::move(value)); }
+      values.clear();
+    }
+    chain.flush();
+    out_pipe->close();
+  }
+
+  typename Pipe<T>::ptr _source;
+  std::tuple<Stages...> _stages;
+};
+
+template <class T, pipeline_stage S>
+Pipeline<T, std::decay_t<S>> operator|(
+  const std::shared_ptr<Pipe<T>>& pipe, S&& stage)
+{
+  return Pipeline<T, std::decay_t<S>>(
+    pipe, std::make_tuple(std::forward<S>(stage)));
+}
+
+template <class T, pipeline_stage... Stages, pipeline_stage S>
+Pipeline<T, Stages..., std::decay_t<S>> operator|(
+  Pipeline<T, Stages...>&& pipeline, S&& stage)
+{
+  return std::move(pipeline).then(std::forward<S>(stage));
+}
+
+} // namespace async
@@ -0,0 +1,87 @@
+#include "pipeline.hpp"
+
+#include <string>
+
+#include "testing.hpp"
+
+namespace async {
+namespace {
+
+ASYNC_TEST(map_filter_batch)
+{
+  auto pipe = Pipe<int>::create();
+
+  auto task = schedule_task([&]() {
+    return (pipe | ops::map([](int v) { return v * v; }) |
+            ops::filter([](int v) { return v % 2 == 0; }) | ops::batch(2))
+      .iter([](std::vector<int> batch) {
+        P("batch of $", batch.size());
+        for (int v : batch) { P(v); }
+      });
+  });
+
+  for (int i = 0; i < 9; i++) { pipe->push(i); }
+  pipe->close();
+
+  co_await task;
+}
+
+ASYNC_TEST(map_returning_reference)
+{
+  struct Person {
+    std::string name;
+    int age;
+  };
+  auto pipe = Pipe<Person>::create();
+
+  auto task = schedule_task([&]() {
+    return (pipe |
+            ops::map([](const Person& p) -> const std::string& {
+              return p.name;
+            }) |
+            ops::map([](std::string name) { return name + "!"; }))
+      .iter([](std::string name) { P(name); });
+  });
+
+  pipe->push(Person{.name = "ann", .age = 30});
+  pipe->push(Person{.name = "bob", .age = 40});
+  pipe->close();
+
+  co_await task;
+}
+
+ASYNC_TEST(flat_map_to_pipe)
+{
+  auto pipe = Pipe<std::string>::create();
+
+  auto words = (pipe | ops::flat_map([](std::string line) {
+                  std::vector<std::string> out;
+                  size_t start = 0;
+                  while (start < line.size()) {
+                    size_t end = line.find(' ', start);
+                    if (end == std::string::npos) { end = line.size(); }
+                    if (end > start) {
+                      out.push_back(line.substr(start, end - start));
+                    }
+                    start = end + 1;
+                  }
+                  return out;
+                }) |
+                ops::map([](std::string w) { return w.size(); }))
+                 .to_pipe();
+
+  auto task =
+    schedule_task([&]() { return words->iter([](size_t v) { P(v); }); });
+
+  pipe->push("one two");
+  pipe->push("three");
+  pipe->push("");
+  pipe->push(" four  five ");
+  pipe->close();
+
+  co_await task;
+  P("closed: $", words->is_closed());
+}
+
+} // namespace
+} // namespace async
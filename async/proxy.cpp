@@ -0,0 +1,167 @@
+#include "proxy.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include "deferred_awaitable.hpp"
+
+#include "bee/fd.hpp"
+
+namespace async {
+
+namespace {
+
+// Half closes the destination so the peer sees EOF. Pipes and other non
+// sockets have no write side to shut down, so they are closed instead.
+bee::OrError<> shutdown_write(const AsyncFD::ptr& fd)
+{
+  if (fd->is_closed()) { return bee::ok(); }
+  if (::shutdown(fd->int_fd(), SHUT_WR) == 0) { return bee::ok(); }
+  if (errno == ENOTSOCK) {
+    fd->close();
+    return bee::ok();
+  }
+  // The peer is already gone
+  if (errno == ENOTCONN) { return bee::ok(); }
+  shot("Failed to shut down fd: $", strerror(errno));
+}
+
+#ifdef __APPLE__
+
+constexpr size_t chunk_size = 64 * 1024;
+
+// No splice, copy through a buffer and wait for each chunk to be flushed
+Task<bee::OrError<>> pump(AsyncFD::ptr from, AsyncFD::ptr to)
+{
+  std::vector<std::byte> buffer(chunk_size);
+  while (true) {
+    if (to->is_closed()) { co_return bee::Error("FD closed while proxying"); }
+    // Closed by the other direction once it was done writing to it
+    if (from->is_closed()) { break; }
+    co_bail(ret, from->read_some(buffer.data(), buffer.size()));
+    if (!ret.has_value()) {
+      co_await from->wait_readable();
+      continue;
+    }
+    if (*ret == 0) { break; }
+    bee::DataBuffer data;
+    data.write(buffer.data(), *ret);
+    co_bail_unit(to->write(std::move(data)));
+    co_bail_unit(co_await to->flushed());
+  }
+  co_return shutdown_write(to);
+}
+
+#else
+
+constexpr int pipe_size = 1024 * 1024;
+
+constexpr unsigned splice_flags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+
+// Returns nullopt on EAGAIN
+bee::OrError<std::optional<size_t>> splice_some(int from, int to, size_t size)
+{
+  while (true) {
+    ssize_t ret = ::splice(from, nullptr, to, nullptr, size, splice_flags);
+    if (ret >= 0) { return std::optional<size_t>(ret); }
+    if (errno == EINTR) { continue; }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) { return std::nullopt; }
+    shot("Failed to splice: $", strerror(errno));
+  }
+}
+
+Task<bee::OrError<>> pump(AsyncFD::ptr from, AsyncFD::ptr to)
+{
+  co_bail(pipe, bee::Pipe::create());
+  co_bail_unit(pipe.read_fd->set_blocking(false));
+  co_bail_unit(pipe.write_fd->set_blocking(false));
+
+  // Raising the size can fail if it's over /proc/sys/fs/pipe-max-size, the
+  // default size still works
+  fcntl(pipe.write_fd->int_fd(), F_SETPIPE_SZ, pipe_size);
+  int capacity = fcntl(pipe.write_fd->int_fd(), F_GETPIPE_SZ);
+  if (capacity <= 0) {
+    co_return bee::Error::fmt("Failed to get pipe size: $", strerror(errno));
+  }
+
+  size_t in_pipe = 0;
+  bool eof = false;
+  while (!eof || in_pipe > 0) {
+    if (to->is_closed()) { co_return bee::Error("FD closed while proxying"); }
+    // Closed by the other direction once it was done writing to it
+    if (from->is_closed()) { eof = true; }
+
+    bool read_blocked = eof || in_pipe == size_t(capacity);
+    if (!read_blocked) {
+      co_bail(
+        ret,
+        splice_some(
+          from->int_fd(), pipe.write_fd->int_fd(), capacity - in_pipe));
+      if (!ret.has_value()) {
+        read_blocked = true;
+      } else if (*ret == 0) {
+        eof = true;
+      } else {
+        in_pipe += *ret;
+      }
+    }
+
+    bool write_blocked = in_pipe == 0;
+    if (!write_blocked) {
+      co_bail(
+        ret, splice_some(pipe.read_fd->int_fd(), to->int_fd(), in_pipe));
+      if (!ret.has_value()) {
+        write_blocked = true;
+      } else {
+        in_pipe -= *ret;
+      }
+    }
+
+    if (!read_blocked || !write_blocked) { continue; }
+
+    // Both sides were just tried, so a notification that arrives while
+    // waiting on the other one is not lost, the next round retries both
+    if (in_pipe > 0) {
+      co_await to->wait_writable();
+    } else {
+      co_await from->wait_readable();
+    }
+  }
+  co_return shutdown_write(to);
+}
+
+#endif
+
+// A failed direction closes both fds, which wakes up the other one
+Task<bee::OrError<>> pump_or_close(AsyncFD::ptr from, AsyncFD::ptr to)
+{
+  auto result = co_await pump(from, to);
+  if (result.is_error()) {
+    from->close();
+    to->close();
+  }
+  co_return result;
+}
+
+} // namespace
+
+Task<bee::OrError<>> proxy(AsyncFD::ptr a, AsyncFD::ptr b)
+{
+  auto a_to_b = pump_or_close(a, b);
+  auto b_to_a = pump_or_close(b, a);
+
+  auto a_to_b_result = co_await a_to_b;
+  auto b_to_a_result = co_await b_to_a;
+
+  a->close();
+  b->close();
+  if (a_to_b_result.is_error()) { co_return a_to_b_result; }
+  co_return b_to_a_result;
+}
+
+} // namespace async
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "async_fd.hpp"
+#include "task.hpp"
+
+#include "bee/error.hpp"
+
+namespace async {
+
+// Copies everything read from a to b and from b to a until both sides reach
+// EOF, then closes both. On Linux the bytes go through a kernel pipe with
+// splice(2) and never reach user space. Each direction stops reading while
+// its destination can't keep up, so at most a pipe's worth of data is
+// buffered per direction.
+//
+// Once a direction reaches EOF its destination is half closed, or closed if
+// it isn't a socket, which also ends the other direction.
+//
+// Nothing else may read from or write to a and b while the proxy runs.
+Task<bee::OrError<>> proxy(AsyncFD::ptr a, AsyncFD::ptr b);
+
+} // namespace async
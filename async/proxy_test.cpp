@@ -0,0 +1,107 @@
+#include "proxy.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "testing.hpp"
+
+namespace async {
+namespace {
+
+bee::OrError<std::pair<AsyncFD::ptr, AsyncFD::ptr>> socket_pair()
+{
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) {
+    shot("Failed to create socket pair: $", strerror(errno));
+  }
+  bail(first, AsyncFD::of_fd(bee::FD(fds[0]).to_shared(), true));
+  bail(second, AsyncFD::of_fd(bee::FD(fds[1]).to_shared(), true));
+  return std::make_pair(first, second);
+}
+
+Task<std::string> read_until_eof(AsyncFD::ptr fd)
+{
+  std::string received;
+  while (true) {
+    bee::DataBuffer buf;
+    must(result, co_await fd->read_async(buf));
+    received += buf.to_string();
+    if (result.is_eof()) { break; }
+  }
+  co_return received;
+}
+
+ASYNC_TEST(both_directions)
+{
+  must(client_pair, socket_pair());
+  must(backend_pair, socket_pair());
+  auto [client, proxy_front] = client_pair;
+  auto [proxy_back, backend] = backend_pair;
+
+  auto proxied = proxy(proxy_front, proxy_back);
+
+  // Much larger than the socket buffers and the proxy's pipe
+  std::string request;
+  for (int i = 0; i < 300000; i++) { request += F("$,", i); }
+
+  auto backend_received = read_until_eof(backend);
+  must_unit(client->write(request));
+  must_unit(co_await client->flushed());
+  shutdown(client->int_fd(), SHUT_WR);
+
+  auto received = co_await backend_received;
+  P("Backend received: $ bytes", received.size());
+  P("Matches: $", received == request);
+
+  auto client_received = read_until_eof(client);
+  must_unit(backend->write("pong"));
+  must_unit(co_await backend->flushed());
+  shutdown(backend->int_fd(), SHUT_WR);
+  P("Client received: $", co_await client_received);
+
+  must_unit(co_await proxied);
+  P("Proxy closed both sides: $", proxy_front->is_closed());
+
+  client->close();
+  backend->close();
+}
+
+ASYNC_TEST(non_socket_destination)
+{
+  must(client_pair, socket_pair());
+  auto [client, proxy_front] = client_pair;
+
+  // A fifo opened for reading and writing is a single non socket fd that
+  // works in both directions
+  std::string path = F("/tmp/proxy_test_fifo_$", getpid());
+  if (mkfifo(path.c_str(), 0600) == -1) {
+    P("Failed to create fifo: $", strerror(errno));
+    co_return;
+  }
+  int fifo_fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+  unlink(path.c_str());
+  must(fifo, AsyncFD::of_fd(bee::FD(fifo_fd).to_shared(), false));
+
+  auto proxied = proxy(proxy_front, fifo);
+
+  // The fifo can't be half closed, it's closed once the client is done,
+  // which ends the other direction too
+  auto client_received = read_until_eof(client);
+  shutdown(client->int_fd(), SHUT_WR);
+  P("Client received: '$'", co_await client_received);
+  auto result = co_await proxied;
+  P("Proxy result: $", result.is_error() ? result.error().msg() : "ok");
+  P("Fifo closed: $", fifo->is_closed());
+
+  client->close();
+}
+
+} // namespace
+} // namespace async
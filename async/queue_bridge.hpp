@@ -1,22 +1,25 @@
 #pragma once
 
-#include <mutex>
+#include <utility>
 
-#include "async.hpp"
 #include "pipe.hpp"
+#include "task.hpp"
+#include "thread_channel.hpp"
 
 namespace async {
 
+// Values pushed from any thread come out of pipe() on the scheduler thread
 template <class T> struct QueueBridge {
  public:
-  QueueBridge(bee::Pipe&& data_pipe) : _data_pipe(std::move(data_pipe))
+  using channel_t = typename ThreadChannel<T>::ptr;
+
+  explicit QueueBridge(channel_t channel) : _channel(std::move(channel))
   {
-    _data_pipe.read_fd->set_blocking(false);
-    add_fd(_data_pipe.read_fd, [this]() {
-      bee::DataBuffer buf;
-      auto res = _data_pipe.read_fd->read_all_available(buf);
-      _flush();
-      if (res.is_error() || res.value().is_eof()) { close(); }
+    async::schedule_task([channel = _channel, pipe = _pipe]() -> Task<> {
+      while (auto value = co_await channel->next_value()) {
+        pipe->push(std::move(*value));
+      }
+      pipe->close();
     });
   }
 
@@ -25,40 +28,35 @@ template <class T> struct QueueBridge {
 
   ~QueueBridge() { close(); }
 
-  void push(T&& item)
+  // Blocks while the channel is full
+  void push(T&& item) { _channel->push(std::move(item)); }
+
+  // Scheduler thread only. Moves what is pushed into the pipe, blocking the
+  // thread, until close_write() is called, then closes the bridge.
+  void drain_until_write_closed()
   {
-    auto lock = std::unique_lock(_mutex);
-    _local_queue.push(std::move(item));
-    _data_pipe.write_fd->write("r");
+    while (auto value = _channel->pop_blocking()) {
+      _pipe->push(std::move(*value));
+    }
+    close();
   }
 
+  // Scheduler thread only
   void close()
   {
     if (_closed) { return; }
     _closed = true;
-    _flush();
+    _channel->close();
+    while (auto value = _channel->try_pop()) { _pipe->push(std::move(*value)); }
     _pipe->close();
-    remove_fd(_data_pipe.read_fd);
-    _data_pipe.close();
   }
 
-  void close_write() { _data_pipe.write_fd->close(); }
+  void close_write() { _channel->close(); }
 
   const typename Pipe<T>::ptr& pipe() { return _pipe; }
 
  private:
-  void _flush()
-  {
-    auto lk = std::unique_lock(_mutex);
-    while (!_local_queue.empty()) {
-      _pipe->push(std::move(_local_queue.front()));
-      _local_queue.pop();
-    }
-  }
-
-  std::mutex _mutex;
-  std::queue<T> _local_queue;
-  bee::Pipe _data_pipe;
+  channel_t _channel;
 
   typename Pipe<T>::ptr _pipe = Pipe<T>::create();
 
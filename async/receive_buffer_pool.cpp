@@ -0,0 +1,190 @@
+#include "receive_buffer_pool.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+
+#include <sys/mman.h>
+
+namespace async {
+
+////////////////////////////////////////////////////////////////////////////////
+// PooledBuffer
+//
+
+PooledBuffer::PooledBuffer(
+  std::shared_ptr<ReceiveBufferPool> pool, std::byte* data)
+    : _pool(std::move(pool)), _data(data)
+{}
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other)
+    : _pool(std::move(other._pool)), _data(other._data), _size(other._size)
+{
+  other._data = nullptr;
+  other._size = 0;
+}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other)
+{
+  if (this == &other) { return *this; }
+  reset();
+  _pool = std::move(other._pool);
+  _data = other._data;
+  _size = other._size;
+  other._data = nullptr;
+  other._size = 0;
+  return *this;
+}
+
+PooledBuffer::~PooledBuffer() { reset(); }
+
+void PooledBuffer::set_size(size_t size)
+{
+  assert(size <= capacity());
+  _size = size;
+}
+
+size_t PooledBuffer::capacity() const
+{
+  return _pool == nullptr ? 0 : _pool->slab_size();
+}
+
+std::string PooledBuffer::to_string() const
+{
+  return std::string(reinterpret_cast<const char*>(_data), _size);
+}
+
+void PooledBuffer::reset()
+{
+  if (_pool == nullptr) { return; }
+  _pool->_release(_data);
+  _pool = nullptr;
+  _data = nullptr;
+  _size = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// ReceiveBufferPool
+//
+
+ReceiveBufferPool::ReceiveBufferPool(const Options& options)
+    : _options(options)
+{}
+
+ReceiveBufferPool::~ReceiveBufferPool()
+{
+  // Buffers hold a reference to the pool, so none can be in use here
+  assert(_in_use == 0);
+  for (const auto& [address, chunk] : _chunks) { munmap(address, chunk.size); }
+}
+
+ReceiveBufferPool::ptr ReceiveBufferPool::create(const Options& options)
+{
+  assert(options.slab_size > 0 && options.slabs_per_chunk > 0);
+  return ptr(new ReceiveBufferPool(options));
+}
+
+bee::OrError<PooledBuffer> ReceiveBufferPool::acquire()
+{
+  if (_free.empty()) { bail_unit(_add_chunk()); }
+  auto slab = _free.back();
+  _free.pop_back();
+  auto& chunk = _chunk_of(slab)->second;
+  if (chunk.slabs_free-- == _options.slabs_per_chunk) { _idle_chunks--; }
+  _in_use++;
+  _peak_in_use = std::max(_peak_in_use, _in_use);
+  return PooledBuffer(shared_from_this(), slab);
+}
+
+ReceiveBufferPool::Stats ReceiveBufferPool::stats() const
+{
+  return Stats{
+    .slab_size = _options.slab_size,
+    .slabs_total = _chunks.size() * _options.slabs_per_chunk,
+    .slabs_in_use = _in_use,
+    .peak_slabs_in_use = _peak_in_use,
+    .chunks = _chunks.size(),
+    .huge_page_chunks = _huge_page_chunks,
+  };
+}
+
+bee::OrError<> ReceiveBufferPool::_add_chunk()
+{
+  size_t size = _options.slab_size * _options.slabs_per_chunk;
+  int prot = PROT_READ | PROT_WRITE;
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+  void* address = MAP_FAILED;
+  bool huge = false;
+#ifdef MAP_HUGETLB
+  // Fails unless huge pages were reserved and size is a multiple of their size
+  if (_options.huge_pages) {
+    address = mmap(nullptr, size, prot, flags | MAP_HUGETLB, -1, 0);
+    huge = address != MAP_FAILED;
+  }
+#endif
+  if (address == MAP_FAILED) {
+    address = mmap(nullptr, size, prot, flags, -1, 0);
+    if (address == MAP_FAILED) {
+      shot("Failed to allocate receive buffers: $", strerror(errno));
+    }
+#ifdef MADV_HUGEPAGE
+    if (_options.huge_pages) { madvise(address, size, MADV_HUGEPAGE); }
+#endif
+  }
+
+  auto base = static_cast<std::byte*>(address);
+  _chunks.emplace(
+    base,
+    Chunk{.size = size, .slabs_free = _options.slabs_per_chunk, .huge = huge});
+  _idle_chunks++;
+  if (huge) { _huge_page_chunks++; }
+  // Reversed so slabs are handed out in address order
+  for (size_t i = _options.slabs_per_chunk; i > 0; i--) {
+    _free.push_back(base + (i - 1) * _options.slab_size);
+  }
+  return bee::ok();
+}
+
+void ReceiveBufferPool::trim()
+{
+  for (auto it = _chunks.begin(); it != _chunks.end();) {
+    auto next = std::next(it);
+    if (it->second.slabs_free == _options.slabs_per_chunk) { _unmap(it); }
+    it = next;
+  }
+}
+
+void ReceiveBufferPool::_release(std::byte* slab)
+{
+  assert(_in_use > 0);
+  _in_use--;
+  _free.push_back(slab);
+  auto it = _chunk_of(slab);
+  if (++it->second.slabs_free < _options.slabs_per_chunk) { return; }
+  if (++_idle_chunks > _options.max_idle_chunks) { _unmap(it); }
+}
+
+ReceiveBufferPool::ChunkMap::iterator ReceiveBufferPool::_chunk_of(
+  std::byte* slab)
+{
+  auto it = _chunks.upper_bound(slab);
+  assert(it != _chunks.begin());
+  return std::prev(it);
+}
+
+void ReceiveBufferPool::_unmap(ChunkMap::iterator it)
+{
+  auto base = it->first;
+  auto end = base + it->second.size;
+  std::erase_if(
+    _free, [&](std::byte* slab) { return slab >= base && slab < end; });
+  munmap(base, it->second.size);
+  _idle_chunks--;
+  if (it->second.huge) { _huge_page_chunks--; }
+  _chunks.erase(it);
+}
+
+} // namespace async
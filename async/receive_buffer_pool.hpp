@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bee/error.hpp"
+
+namespace async {
+
+struct ReceiveBufferPool;
+
+// A slab borrowed from a ReceiveBufferPool, returned to it on destruction.
+// A default constructed PooledBuffer holds no slab.
+struct PooledBuffer {
+ public:
+  PooledBuffer() = default;
+
+  PooledBuffer(const PooledBuffer&) = delete;
+  PooledBuffer(PooledBuffer&& other);
+
+  PooledBuffer& operator=(const PooledBuffer&) = delete;
+  PooledBuffer& operator=(PooledBuffer&& other);
+
+  ~PooledBuffer();
+
+  std::byte* data() { return _data; }
+  const std::byte* data() const { return _data; }
+
+  // Number of bytes filled in, set by whoever wrote into the slab
+  size_t size() const { return _size; }
+  void set_size(size_t size);
+
+  size_t capacity() const;
+
+  bool empty() const { return _size == 0; }
+
+  std::string to_string() const;
+
+  // Gives the slab back to the pool early
+  void reset();
+
+ private:
+  friend ReceiveBufferPool;
+
+  PooledBuffer(std::shared_ptr<ReceiveBufferPool> pool, std::byte* data);
+
+  std::shared_ptr<ReceiveBufferPool> _pool;
+  std::byte* _data = nullptr;
+  size_t _size = 0;
+};
+
+// Fixed size receive slabs carved out of large mmapped chunks. Slabs are
+// recycled instead of freed, so connections that read in bursts don't churn
+// malloc, and memory is only held by reads whose data hasn't been consumed
+// yet. Once more than max_idle_chunks chunks have no slab in use, the extra
+// ones are returned to the OS.
+//
+// Not thread safe, each scheduler has its own, see receive_buffer_pool() in
+// scheduler_context.hpp.
+struct ReceiveBufferPool
+    : public std::enable_shared_from_this<ReceiveBufferPool> {
+ public:
+  using ptr = std::shared_ptr<ReceiveBufferPool>;
+
+  struct Options {
+    size_t slab_size = 64 * 1024;
+    size_t slabs_per_chunk = 32;
+    // Tries MAP_HUGETLB first, then asks for transparent huge pages
+    bool huge_pages = false;
+    // Chunks with no slab in use kept around for the next burst
+    size_t max_idle_chunks = 1;
+  };
+
+  struct Stats {
+    size_t slab_size;
+    size_t slabs_total;
+    size_t slabs_in_use;
+    size_t peak_slabs_in_use;
+    size_t chunks;
+    size_t huge_page_chunks;
+  };
+
+  ReceiveBufferPool(const ReceiveBufferPool&) = delete;
+  ReceiveBufferPool(ReceiveBufferPool&&) = delete;
+
+  ~ReceiveBufferPool();
+
+  static ptr create(const Options& options);
+
+  bee::OrError<PooledBuffer> acquire();
+
+  size_t slab_size() const { return _options.slab_size; }
+
+  Stats stats() const;
+
+  // Returns every chunk with no slab in use to the OS
+  void trim();
+
+ private:
+  friend PooledBuffer;
+
+  explicit ReceiveBufferPool(const Options& options);
+
+  struct Chunk {
+    size_t size;
+    size_t slabs_free;
+    bool huge;
+  };
+
+  using ChunkMap = std::map<std::byte*, Chunk>;
+
+  bee::OrError<> _add_chunk();
+  void _release(std::byte* slab);
+  ChunkMap::iterator _chunk_of(std::byte* slab);
+  void _unmap(ChunkMap::iterator it);
+
+  Options _options;
+  // By address
+  ChunkMap _chunks;
+  std::vector<std::byte*> _free;
+  size_t _idle_chunks = 0;
+  size_t _in_use = 0;
+  size_t _peak_in_use = 0;
+  size_t _huge_page_chunks = 0;
+};
+
+} // namespace async
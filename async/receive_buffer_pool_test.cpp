@@ -0,0 +1,96 @@
+#include "receive_buffer_pool.hpp"
+
+#include <cstring>
+#include <vector>
+
+#include "bee/testing.hpp"
+
+namespace async {
+namespace {
+
+void print_stats(const ReceiveBufferPool::ptr& pool)
+{
+  auto stats = pool->stats();
+  P("slab_size:$ total:$ in_use:$ peak:$ chunks:$",
+    stats.slab_size,
+    stats.slabs_total,
+    stats.slabs_in_use,
+    stats.peak_slabs_in_use,
+    stats.chunks);
+}
+
+TEST(recycles_slabs)
+{
+  auto pool = ReceiveBufferPool::create(
+    {.slab_size = 4096, .slabs_per_chunk = 4, .huge_pages = false});
+  print_stats(pool);
+
+  std::vector<PooledBuffer> buffers;
+  for (int i = 0; i < 6; i++) {
+    must(buffer, pool->acquire());
+    buffers.push_back(std::move(buffer));
+  }
+  print_stats(pool);
+
+  memcpy(buffers[0].data(), "hello", 5);
+  buffers[0].set_size(5);
+  P("first: '$' capacity:$", buffers[0].to_string(), buffers[0].capacity());
+
+  // The most recently released slab is handed out first, while it's likely
+  // still in cache
+  auto released = buffers[2].data();
+  buffers[2].reset();
+  P("reset releases: $", buffers[2].capacity() == 0);
+  must(again, pool->acquire());
+  P("reused the released slab: $", again.data() == released);
+
+  buffers.clear();
+  print_stats(pool);
+  again.reset();
+  print_stats(pool);
+}
+
+TEST(releases_idle_chunks)
+{
+  auto pool = ReceiveBufferPool::create(
+    {.slab_size = 4096,
+     .slabs_per_chunk = 2,
+     .huge_pages = false,
+     .max_idle_chunks = 1});
+
+  std::vector<PooledBuffer> buffers;
+  for (int i = 0; i < 6; i++) {
+    must(buffer, pool->acquire());
+    buffers.push_back(std::move(buffer));
+  }
+  print_stats(pool);
+
+  // Only one of the chunks that go idle is kept
+  buffers.erase(buffers.begin(), buffers.begin() + 4);
+  print_stats(pool);
+
+  must(buffer, pool->acquire());
+  print_stats(pool);
+
+  buffers.clear();
+  buffer.reset();
+  print_stats(pool);
+
+  pool->trim();
+  print_stats(pool);
+}
+
+TEST(huge_pages_fall_back)
+{
+  // Works whether or not huge pages are reserved on this machine
+  auto pool = ReceiveBufferPool::create(
+    {.slab_size = 64 * 1024, .slabs_per_chunk = 32, .huge_pages = true});
+  must(buffer, pool->acquire());
+  memset(buffer.data(), 'x', buffer.capacity());
+  buffer.set_size(buffer.capacity());
+  P("size: $", buffer.size());
+  P("chunks: $", pool->stats().chunks);
+}
+
+} // namespace
+} // namespace async
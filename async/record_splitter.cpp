@@ -0,0 +1,70 @@
+#include "record_splitter.hpp"
+
+#include <utility>
+
+#include "find_byte.hpp"
+
+namespace async {
+
+RecordSplitter::RecordSplitter(char delimiter, size_t max_record_size)
+    : _delimiter(std::byte(delimiter)), _max_record_size(max_record_size)
+{}
+
+bee::OrError<> RecordSplitter::feed(
+  const bee::DataBuffer& data, const record_callback& on_record)
+{
+  for (const auto& block : data) {
+    bail_unit(feed(
+      std::string_view(
+        reinterpret_cast<const char*>(block.data()), block.size()),
+      on_record));
+  }
+  return bee::ok();
+}
+
+bee::OrError<> RecordSplitter::feed(
+  std::string_view data, const record_callback& on_record)
+{
+  auto pos = reinterpret_cast<const std::byte*>(data.data());
+  auto end = pos + data.size();
+  while (pos != end) {
+    auto found = find_byte(pos, end, _delimiter);
+    auto begin = reinterpret_cast<const char*>(pos);
+    auto stop = reinterpret_cast<const char*>(found);
+    if (found == end) {
+      bail_unit(_append_partial(begin, stop));
+      break;
+    }
+    if (_partial.empty()) {
+      if (size_t(stop - begin) > _max_record_size) {
+        shot("Record longer than $ bytes", _max_record_size);
+      }
+      on_record(std::string_view(begin, stop - begin));
+    } else {
+      bail_unit(_append_partial(begin, stop));
+      on_record(_partial);
+      _partial.clear();
+    }
+    pos = found + 1;
+  }
+  return bee::ok();
+}
+
+std::optional<std::string> RecordSplitter::finish()
+{
+  if (_partial.empty()) { return std::nullopt; }
+  return std::exchange(_partial, std::string());
+}
+
+bee::OrError<> RecordSplitter::_append_partial(
+  const char* begin, const char* end)
+{
+  if (_partial.size() + (end - begin) > _max_record_size) {
+    _partial.clear();
+    shot("Record longer than $ bytes", _max_record_size);
+  }
+  _partial.append(begin, end);
+  return bee::ok();
+}
+
+} // namespace async
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "bee/data_buffer.hpp"
+#include "bee/error.hpp"
+
+namespace async {
+
+// Splits a stream of DataBuffer chunks, or any other contiguous pieces like
+// MmapChunks, into records ending in a delimiter byte. Records that lie
+// within one block are passed to the callback as views into it, only the part
+// of a record that straddles blocks is copied.
+struct RecordSplitter {
+ public:
+  using record_callback = std::function<void(std::string_view record)>;
+
+  explicit RecordSplitter(
+    char delimiter = '\n', size_t max_record_size = 1024 * 1024);
+
+  // Calls on_record, without the delimiter, for every record completed by
+  // data. Views are only valid during the call.
+  bee::OrError<> feed(
+    const bee::DataBuffer& data, const record_callback& on_record);
+  bee::OrError<> feed(std::string_view data, const record_callback& on_record);
+
+  // The unterminated data at the end of the stream, if any
+  std::optional<std::string> finish();
+
+  size_t partial_size() const { return _partial.size(); }
+
+ private:
+  bee::OrError<> _append_partial(const char* begin, const char* end);
+
+  std::byte _delimiter;
+  size_t _max_record_size;
+  std::string _partial;
+};
+
+} // namespace async
@@ -0,0 +1,79 @@
+#include "record_splitter.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "find_byte.hpp"
+
+#include "bee/testing.hpp"
+
+namespace async {
+namespace {
+
+void feed_and_print(RecordSplitter& splitter, bee::DataBuffer data)
+{
+  auto result = splitter.feed(data, [](std::string_view record) {
+    P("Record: '$'", std::string(record));
+  });
+  if (result.is_error()) { P("Error: $", result.error()); }
+}
+
+TEST(split_lines)
+{
+  RecordSplitter splitter;
+
+  bee::DataBuffer data;
+  data.write("first\nsec");
+  data.write("ond\n\nthi");
+  data.write("r");
+  data.write("d\nfourth");
+  feed_and_print(splitter, std::move(data));
+  P("Partial: $", splitter.partial_size());
+
+  feed_and_print(splitter, bee::DataBuffer("\nunterminated"));
+  auto rest = splitter.finish();
+  P("Finish: '$'", rest.value_or("<none>"));
+  P("Finish again: $", splitter.finish().has_value());
+}
+
+TEST(custom_delimiter_and_limit)
+{
+  RecordSplitter splitter('|', 8);
+  feed_and_print(splitter, bee::DataBuffer("a|bb|12345678|"));
+  feed_and_print(splitter, bee::DataBuffer("123456789|"));
+
+  bee::DataBuffer data;
+  data.write("12345");
+  data.write("6789|");
+  feed_and_print(splitter, std::move(data));
+  feed_and_print(splitter, bee::DataBuffer("ok|"));
+}
+
+TEST(find_byte_matches_scalar)
+{
+  std::mt19937 rng(42);
+  int mismatches = 0;
+  int checks = 0;
+  for (size_t size = 0; size < 300; size++) {
+    std::vector<std::byte> data(size + 1);
+    for (auto& b : data) { b = std::byte(rng() % 4 == 0 ? '\n' : 'x'); }
+    // Also try all alignments and a buffer without the needle
+    for (size_t offset = 0; offset <= std::min<size_t>(size, 33); offset++) {
+      auto begin = data.data() + offset;
+      auto end = data.data() + size;
+      for (auto needle : {std::byte('\n'), std::byte('y')}) {
+        checks++;
+        if (
+          find_byte(begin, end, needle) !=
+          find_byte_scalar(begin, end, needle)) {
+          mismatches++;
+        }
+      }
+    }
+  }
+  P("Checks: $ mismatches: $", checks, mismatches);
+}
+
+} // namespace
+} // namespace async
@@ -4,4 +4,18 @@ namespace async {
 
 Scheduler::~Scheduler() {}
 
+const ReceiveBufferPool::ptr& Scheduler::receive_buffer_pool()
+{
+  if (_receive_buffer_pool == nullptr) {
+    _receive_buffer_pool =
+      ReceiveBufferPool::create(ReceiveBufferPool::Options());
+  }
+  return _receive_buffer_pool;
+}
+
+void Scheduler::set_receive_buffer_pool(ReceiveBufferPool::ptr pool)
+{
+  _receive_buffer_pool = std::move(pool);
+}
+
 } // namespace async
@@ -2,6 +2,8 @@
 
 #include <functional>
 
+#include "receive_buffer_pool.hpp"
+
 #include "bee/error.hpp"
 #include "bee/fd.hpp"
 #include "bee/span.hpp"
@@ -38,6 +40,11 @@ struct Scheduler {
 
   virtual bee::OrError<> remove_fd(const bee::FD::shared_ptr& fd) = 0;
 
+  // Makes sure the fd's callback runs once it's writable, even if no write
+  // through the fd has blocked, e.g. while a raw connect or sendfile is in
+  // progress. Schedulers that always watch writability can ignore it.
+  virtual void want_writable(const bee::FD::shared_ptr& fd) = 0;
+
   virtual void schedule(std::function<void()>&& f) = 0;
 
   virtual void close() = 0;
@@ -50,6 +57,17 @@ struct Scheduler {
   virtual void cancel(TimedTaskId task_id) = 0;
 
   virtual void on_exit(std::function<void()>&& on_exit) = 0;
+
+  // Runs callback once, after the tasks of the current tick and right before
+  // the scheduler blocks waiting for events
+  virtual void before_wait(std::function<void()>&& callback) = 0;
+
+  // Slabs for pooled reads, created with the default options on first use
+  const ReceiveBufferPool::ptr& receive_buffer_pool();
+  void set_receive_buffer_pool(ReceiveBufferPool::ptr pool);
+
+ private:
+  ReceiveBufferPool::ptr _receive_buffer_pool;
 };
 
 } // namespace async
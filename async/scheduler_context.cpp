@@ -83,4 +83,19 @@ bee::OrError<> remove_fd(const bee::FD::shared_ptr& fd)
   return SchedulerContext::scheduler().remove_fd(fd);
 }
 
+void want_writable(const bee::FD::shared_ptr& fd)
+{
+  SchedulerContext::scheduler().want_writable(fd);
+}
+
+const ReceiveBufferPool::ptr& receive_buffer_pool()
+{
+  return SchedulerContext::scheduler().receive_buffer_pool();
+}
+
+void set_receive_buffer_pool(ReceiveBufferPool::ptr pool)
+{
+  SchedulerContext::scheduler().set_receive_buffer_pool(std::move(pool));
+}
+
 } // namespace async
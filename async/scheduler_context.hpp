@@ -38,9 +38,20 @@ template <class F> TimedTaskId after(const bee::Span& span, F&& callback)
 
 void cancel(TimedTaskId task_id);
 
+template <class F> void before_wait(F&& callback)
+{
+  SchedulerContext::scheduler().before_wait(std::forward<F>(callback));
+}
+
 bee::OrError<> add_fd(
   const bee::FD::shared_ptr& fd, std::function<void()>&& callback);
 
 bee::OrError<> remove_fd(const bee::FD::shared_ptr& fd);
 
+void want_writable(const bee::FD::shared_ptr& fd);
+
+const ReceiveBufferPool::ptr& receive_buffer_pool();
+
+void set_receive_buffer_pool(ReceiveBufferPool::ptr pool);
+
 } // namespace async
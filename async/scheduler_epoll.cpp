@@ -11,6 +11,7 @@
 
 #include "async.hpp"
 #include "scheduler.hpp"
+#include "trace.hpp"
 
 #include "bee/time.hpp"
 
@@ -78,12 +79,17 @@ struct SchedulerEpollImpl : public Scheduler {
     }
     auto id = it->second;
 
+    // The fd may stay open and be added again
+    epoll_ctl(_epoll_fd.int_fd(), EPOLL_CTL_DEL, fd->int_fd(), nullptr);
     _fd_to_id.erase(fd);
     _callbacks.erase(id);
 
     return bee::ok();
   }
 
+  // Fds are always registered with EPOLLOUT
+  virtual void want_writable(const FD::shared_ptr&) {}
+
   virtual void schedule(function<void()>&& f)
   {
     _primary_task_queue.emplace_back(std::move(f));
@@ -101,6 +107,7 @@ struct SchedulerEpollImpl : public Scheduler {
   {
     do {
       _move_time();
+      _run_before_wait();
 
       Span timeout = max_timeout;
       if (stop() || !_primary_task_queue.empty()) { timeout = Span::zero(); }
@@ -137,16 +144,39 @@ struct SchedulerEpollImpl : public Scheduler {
     _on_exit.push_back(std::move(on_exit));
   }
 
+  virtual void before_wait(std::function<void()>&& callback)
+  {
+    _before_wait.push_back(std::move(callback));
+  }
+
  private:
   bee::OrError<> _add_fd(const FD& fd, std::function<void()> callback);
 
   void _run_tasks_until_empty()
   {
     swap(_primary_task_queue, _secondary_task_queue);
-    for (auto& t : _secondary_task_queue) { t(); }
+    if (Tracer::is_enabled()) {
+      for (auto& t : _secondary_task_queue) {
+        Tracer::callback_begin();
+        t();
+        Tracer::callback_end();
+      }
+    } else {
+      for (auto& t : _secondary_task_queue) { t(); }
+    }
     _secondary_task_queue.clear();
   }
 
+  // Callbacks may schedule tasks, in which case the wait doesn't block
+  void _run_before_wait()
+  {
+    while (!_before_wait.empty()) {
+      auto callbacks = std::move(_before_wait);
+      _before_wait.clear();
+      for (auto& f : callbacks) { f(); }
+    }
+  }
+
   void _move_time()
   {
     auto now = Time::monotonic();
@@ -222,6 +252,7 @@ struct SchedulerEpollImpl : public Scheduler {
   std::vector<std::function<void()>> _secondary_task_queue;
 
   std::vector<std::function<void()>> _on_exit;
+  std::vector<std::function<void()>> _before_wait;
 
   Time _last_now = Time::zero();
 };
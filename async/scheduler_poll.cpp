@@ -8,6 +8,7 @@
 
 #include "async.hpp"
 #include "scheduler.hpp"
+#include "trace.hpp"
 
 #include "bee/fd.hpp"
 
@@ -46,9 +47,15 @@ bee::OrError<> SchedulerPoll::add_fd(
 bee::OrError<> SchedulerPoll::remove_fd(const FD::shared_ptr& fd)
 {
   _callbacks.erase(fd);
+  _want_writable.erase(fd);
   return bee::ok();
 }
 
+void SchedulerPoll::want_writable(const FD::shared_ptr& fd)
+{
+  _want_writable.insert(fd);
+}
+
 const Span max_timeout = Span::of_seconds(60);
 
 bee::OrError<> SchedulerPoll::wait(Span timeout)
@@ -67,6 +74,9 @@ bee::OrError<> SchedulerPoll::wait(Span timeout)
     if (remaining < timeout) { timeout = remaining; }
   }
 
+  _run_before_wait();
+  if (!_task_queue.empty()) { timeout = Span::zero(); }
+
   // clear up collected fds
   for (auto it = _callbacks.begin(); it != _callbacks.end(); it++) {
     if (it->first.expired()) {
@@ -75,14 +85,18 @@ bee::OrError<> SchedulerPoll::wait(Span timeout)
       _callbacks.erase(to_delete);
     }
   }
+  std::erase_if(
+    _want_writable, [](const auto& fd) { return fd.expired(); });
 
   vector<pollfd> poll_fds;
   vector<weak_ptr<FD>> fds;
   for (const auto& fdp : _callbacks) {
     auto fd = fdp.first.lock();
-    short events = POLLIN;
-    if (fd->is_write_blocked()) { events |= POLLOUT; }
     if (fd == nullptr) { continue; }
+    short events = POLLIN;
+    if (fd->is_write_blocked() || _want_writable.contains(fdp.first)) {
+      events |= POLLOUT;
+    }
     poll_fds.push_back({.fd = fd->int_fd(), .events = events, .revents = 0});
     fds.push_back(fdp.first);
   }
@@ -100,6 +114,9 @@ bee::OrError<> SchedulerPoll::wait(Span timeout)
       auto& pollfd = poll_fds.at(i);
       if (pollfd.revents == 0) continue;
       auto fd = fds.at(i);
+      if (pollfd.revents & (POLLOUT | POLLERR | POLLHUP)) {
+        _want_writable.erase(fd);
+      }
       schedule([this, fd]() {
         auto it = _callbacks.find(fd);
         if (it == _callbacks.end()) return;
@@ -135,9 +152,18 @@ SchedulerPoll::~SchedulerPoll() {}
 
 void SchedulerPoll::_run_tasks_until_empty()
 {
-  while (!_task_queue.empty()) {
-    _task_queue.front()();
-    _task_queue.pop();
+  if (Tracer::is_enabled()) {
+    while (!_task_queue.empty()) {
+      Tracer::callback_begin();
+      _task_queue.front()();
+      Tracer::callback_end();
+      _task_queue.pop();
+    }
+  } else {
+    while (!_task_queue.empty()) {
+      _task_queue.front()();
+      _task_queue.pop();
+    }
   }
 }
 
@@ -157,6 +183,20 @@ void SchedulerPoll::on_exit(std::function<void()>&& on_exit)
   _on_exit.push_back(std::move(on_exit));
 }
 
+void SchedulerPoll::before_wait(std::function<void()>&& callback)
+{
+  _before_wait.push_back(std::move(callback));
+}
+
+void SchedulerPoll::_run_before_wait()
+{
+  while (!_before_wait.empty()) {
+    auto callbacks = std::move(_before_wait);
+    _before_wait.clear();
+    for (auto& f : callbacks) { f(); }
+  }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // TimedTask
 //
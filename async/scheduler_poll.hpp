@@ -31,6 +31,8 @@ struct SchedulerPoll : public Scheduler {
 
   virtual bee::OrError<> remove_fd(const bee::FD::shared_ptr& fd);
 
+  virtual void want_writable(const bee::FD::shared_ptr& fd);
+
   virtual bee::OrError<> wait(bee::Span timeout);
 
   virtual void schedule(std::function<void()>&& f);
@@ -46,6 +48,8 @@ struct SchedulerPoll : public Scheduler {
 
   virtual void on_exit(std::function<void()>&& on_exit);
 
+  virtual void before_wait(std::function<void()>&& callback);
+
  private:
   SchedulerPoll();
 
@@ -57,6 +61,11 @@ struct SchedulerPoll : public Scheduler {
     std::owner_less<std::weak_ptr<bee::FD>>>
     _callbacks;
 
+  // Fds that get POLLOUT until they are next ready, on top of the write
+  // blocked ones
+  std::set<std::weak_ptr<bee::FD>, std::owner_less<std::weak_ptr<bee::FD>>>
+    _want_writable;
+
   std::queue<std::function<void()>> _task_queue;
 
   struct TimedTask {
@@ -69,8 +78,10 @@ struct SchedulerPoll : public Scheduler {
   std::priority_queue<TimedTask> _timed_task_queue;
 
   void _run_tasks_until_empty();
+  void _run_before_wait();
 
   std::vector<std::function<void()>> _on_exit;
+  std::vector<std::function<void()>> _before_wait;
 };
 
 } // namespace async
@@ -17,5 +17,9 @@ TEST(basic) { test_impl.basic_test(); }
 
 TEST(large_data) { test_impl.large_data(); }
 
+TEST(connect) { test_impl.connect(); }
+
+TEST(send_file) { test_impl.send_file(); }
+
 } // namespace
 } // namespace async
@@ -1,10 +1,14 @@
 #include "scheduler_test_common.hpp"
 
+#include <stdlib.h>
+#include <unistd.h>
+
 #include "deferred_awaitable.hpp"
 #include "run_scheduler.hpp"
 #include "socket.hpp"
 
 #include "bee/data_buffer.hpp"
+#include "bee/fd.hpp"
 
 using bee::DataBuffer;
 
@@ -43,7 +47,7 @@ Task<> basic_test_impl()
   must(port, server->port());
 
   must(ip, SocketClient::resolve_host("localhost"));
-  must(client, SocketClient::connect(ip, port));
+  must(client, co_await SocketClient::connect(ip, port));
 
   client->set_data_callback([=](const bee::OrError<DataBuffer>& buf_or_err) {
     must(buf, buf_or_err);
@@ -84,7 +88,7 @@ Task<> large_data_impl()
   must(port, server->port());
 
   must(ip, SocketClient::resolve_host("localhost"));
-  must(client, SocketClient::connect(ip, port));
+  must(client, co_await SocketClient::connect(ip, port));
 
   auto recv_count = make_shared<int>(0);
   auto buffer = make_shared<DataBuffer>();
@@ -107,6 +111,78 @@ Task<> large_data_impl()
   client->close();
 }
 
+// The server waits for the client to speak first, so nothing but the
+// connect completing makes the client socket ready
+Task<> connect_impl()
+{
+  must(
+    server,
+    SocketServer::listen(
+      nullopt, [](bee::OrError<SocketClient::ptr>&& sock_or_err) -> Task<> {
+        must(sock, sock_or_err);
+        sock->set_data_callback([sock](bee::OrError<DataBuffer>&& buf_or_err) {
+          must(buf, buf_or_err);
+          if (buf.empty()) {
+            sock->close();
+          } else {
+            must_unit(sock->send(std::move(buf)));
+          }
+        });
+        co_return;
+      }));
+
+  must(port, server->port());
+  must(ip, SocketClient::resolve_host("localhost"));
+  must(
+    client,
+    co_await SocketClient::connect(ip, port, bee::Span::of_seconds(5)));
+
+  auto done = Ivar<>::create();
+  client->set_data_callback([=](bee::OrError<DataBuffer>&& buf_or_err) {
+    must(buf, buf_or_err);
+    P("echoed: $", buf);
+    done->fill();
+  });
+  must_unit(client->send("ping"));
+  co_await done;
+  client->close();
+
+  server->close();
+  auto refused =
+    co_await SocketClient::connect(ip, port, bee::Span::of_seconds(5));
+  P("refused: $", refused.is_error());
+}
+
+// More than a pipe's worth, so sendfile hits EAGAIN and has to wait for the
+// pipe to be writable
+Task<> send_file_impl()
+{
+  string path = "/tmp/scheduler_test_common_XXXXXX";
+  bee::FD file(mkstemp(path.data()));
+  unlink(path.c_str());
+  string content;
+  for (int i = 0; i < 100000; i++) { content += F("$,", i); }
+  must_unit(file.write(content));
+
+  must(pipe, DataPipe::create());
+  auto read_all = [](AsyncFD::ptr fd) -> Task<size_t> {
+    size_t received = 0;
+    while (true) {
+      DataBuffer buf;
+      must(result, co_await fd->read_async(buf));
+      received += buf.size();
+      if (result.is_eof()) { break; }
+    }
+    co_return received;
+  };
+  auto received = read_all(pipe.read_fd);
+
+  must(sent, co_await pipe.write_fd->send_file(file, 0, content.size()));
+  pipe.write_fd->close();
+  P("sent all: $", sent == content.size());
+  P("received all: $", co_await received == content.size());
+}
+
 } // namespace
 
 void SchedulerTestCommon::basic_test()
@@ -121,5 +197,17 @@ void SchedulerTestCommon::large_data()
   RunScheduler::run(large_data_impl, std::move(ctx));
 }
 
+void SchedulerTestCommon::connect()
+{
+  must(ctx, create_context());
+  RunScheduler::run(connect_impl, std::move(ctx));
+}
+
+void SchedulerTestCommon::send_file()
+{
+  must(ctx, create_context());
+  RunScheduler::run(send_file_impl, std::move(ctx));
+}
+
 } // namespace test
 } // namespace async
@@ -8,6 +8,8 @@ struct SchedulerTestCommon {
  public:
   void basic_test();
   void large_data();
+  void connect();
+  void send_file();
 
   virtual bee::OrError<SchedulerContext> create_context() = 0;
 };
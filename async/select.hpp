@@ -0,0 +1,287 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "async.hpp"
+#include "deferred_awaitable.hpp"
+#include "pipe.hpp"
+#include "task.hpp"
+
+#include "bee/unit.hpp"
+
+namespace async {
+
+namespace details {
+
+// Shared between a select and the sources it watches. Every time the select
+// goes back to sleep it gets a fresh wake ivar, sources fill whichever one is
+// current.
+struct SelectRound {
+ public:
+  using ptr = std::shared_ptr<SelectRound>;
+
+  Ivar<>::ptr rearm()
+  {
+    wake = Ivar<>::create();
+    return wake;
+  }
+
+  void signal()
+  {
+    if (wake != nullptr && !wake->is_determined()) { wake->fill(); }
+  }
+
+  Ivar<>::ptr wake;
+};
+
+template <class S> struct select_source;
+
+// A closed pipe is selected with nullopt. Pipes are watched through ready(),
+// so a pipe that isn't selected keeps all of its values.
+template <class T> struct select_source<std::shared_ptr<Pipe<T>>> {
+  using result_type = std::optional<T>;
+
+  static std::optional<result_type> try_take(const std::shared_ptr<Pipe<T>>& p)
+  {
+    if (auto value = p->try_next()) { return result_type(std::move(value)); }
+    if (p->is_closed()) { return result_type(); }
+    return std::nullopt;
+  }
+
+  static void watch(
+    const std::shared_ptr<Pipe<T>>& p,
+    const SelectRound::ptr& round,
+    bool&,
+    std::vector<Deferred<>>& keep_alive)
+  {
+    auto ready = p->ready();
+    ready.iter([round]() { round->signal(); });
+    keep_alive.push_back(std::move(ready));
+  }
+};
+
+// Deferreds and tasks are watched once per select, through observers that
+// don't take their only awaiter slot or their value. One that isn't selected
+// can still be awaited, before or after it is determined.
+template <class T> struct select_source<Deferred<T>> {
+  using result_type = bee::unit_if_void_t<T>;
+
+  static std::optional<result_type> try_take(Deferred<T>& d)
+  {
+    if (!d.is_determined()) { return std::nullopt; }
+    if constexpr (std::is_void_v<T>) {
+      return bee::unit;
+    } else {
+      return std::move(d).value();
+    }
+  }
+
+  static void watch(
+    Deferred<T>& d, const SelectRound::ptr& round, bool& watched, auto&)
+  {
+    if (watched) { return; }
+    watched = true;
+    d.notify_when_determined([round]() { round->signal(); });
+  }
+};
+
+template <class T> struct select_source<Task<T>> {
+  using result_type = bee::unit_if_void_t<T>;
+
+  static std::optional<result_type> try_take(Task<T>& t)
+  {
+    if (!t.done()) { return std::nullopt; }
+    if constexpr (std::is_void_v<T>) {
+      return bee::unit;
+    } else {
+      return t.value();
+    }
+  }
+
+  static void watch(
+    Task<T>& t, const SelectRound::ptr& round, bool& watched, auto&)
+  {
+    if (watched) { return; }
+    watched = true;
+    t.notify_when_done(std::make_shared<Watcher>(round));
+  }
+
+ private:
+  struct Watcher final : public detail::Resumable {
+   public:
+    explicit Watcher(SelectRound::ptr round) : _round(std::move(round)) {}
+
+    virtual void resume() override { _round->signal(); }
+
+   private:
+    SelectRound::ptr _round;
+  };
+};
+
+template <class S>
+using select_result_t = typename select_source<S>::result_type;
+
+template <class... Sources> struct Selector {
+ public:
+  using result_type = std::variant<select_result_t<Sources>...>;
+
+  explicit Selector(Sources&&... sources) : _sources(std::move(sources)...) {}
+
+  std::optional<result_type> try_take()
+  {
+    return _try_take(std::index_sequence_for<Sources...>());
+  }
+
+  Ivar<>::ptr watch()
+  {
+    _keep_alive.clear();
+    auto wake = _round->rearm();
+    _watch(std::index_sequence_for<Sources...>());
+    return wake;
+  }
+
+ private:
+  template <size_t... I>
+  std::optional<result_type> _try_take(std::index_sequence<I...>)
+  {
+    std::optional<result_type> result;
+    (_try_take_one<I>(result) || ...);
+    return result;
+  }
+
+  template <size_t I> bool _try_take_one(std::optional<result_type>& result)
+  {
+    using source = std::tuple_element_t<I, std::tuple<Sources...>>;
+    auto value = select_source<source>::try_take(std::get<I>(_sources));
+    if (!value.has_value()) { return false; }
+    result.emplace(std::in_place_index<I>, std::move(*value));
+    return true;
+  }
+
+  template <size_t... I> void _watch(std::index_sequence<I...>)
+  {
+    (select_source<Sources>::watch(
+       std::get<I>(_sources), _round, _watched[I], _keep_alive),
+     ...);
+  }
+
+  std::tuple<Sources...> _sources;
+  std::array<bool, sizeof...(Sources)> _watched{};
+  std::vector<Deferred<>> _keep_alive;
+  SelectRound::ptr _round = std::make_shared<SelectRound>();
+};
+
+} // namespace details
+
+////////////////////////////////////////////////////////////////////////////////
+// select
+//
+// Waits until one of the sources is ready and returns its value, with the
+// variant index telling which source it came from. Sources can be pipes,
+// deferreds and tasks. When several are ready, the first one in argument order
+// wins. Only the selected source is consumed.
+//
+
+template <class... Sources>
+  requires(sizeof...(Sources) > 0)
+Task<std::variant<details::select_result_t<Sources>...>> select(
+  Sources... sources)
+{
+  details::Selector<Sources...> selector(std::move(sources)...);
+  while (true) {
+    // A pipe that woke us up can still lose its value to another reader, in
+    // which case we go back to waiting
+    if (auto result = selector.try_take()) { co_return std::move(*result); }
+    co_await selector.watch();
+  }
+}
+
+// Returns the index of the selected pipe along with its value, or nullopt if
+// that pipe is closed
+template <class T>
+Task<std::pair<size_t, std::optional<T>>> select(
+  std::vector<std::shared_ptr<Pipe<T>>> pipes)
+{
+  assert(!pipes.empty());
+  auto round = std::make_shared<details::SelectRound>();
+  std::vector<Deferred<>> keep_alive;
+  bool unused = false;
+  while (true) {
+    for (size_t i = 0; i < pipes.size(); i++) {
+      auto value = details::select_source<std::shared_ptr<Pipe<T>>>::try_take(
+        pipes[i]);
+      if (value.has_value()) {
+        co_return std::pair<size_t, std::optional<T>>(i, std::move(*value));
+      }
+    }
+    keep_alive.clear();
+    auto wake = round->rearm();
+    for (const auto& pipe : pipes) {
+      details::select_source<std::shared_ptr<Pipe<T>>>::watch(
+        pipe, round, unused, keep_alive);
+    }
+    co_await wake;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// merge
+//
+// Fans several pipes into one from a single coroutine. Inputs are visited
+// round robin, one value at a time, so a busy pipe can't starve the others.
+// The output is closed once every input is closed.
+//
+
+namespace details {
+
+template <class T>
+Task<> merge_into(
+  std::vector<std::shared_ptr<Pipe<T>>> inputs,
+  std::shared_ptr<Pipe<T>> out_pipe)
+{
+  auto round = std::make_shared<SelectRound>();
+  std::vector<Deferred<>> keep_alive;
+  bool unused = false;
+  while (!inputs.empty() && !out_pipe->is_closed()) {
+    bool forwarded = false;
+    for (size_t i = 0; i < inputs.size() && !out_pipe->is_closed();) {
+      if (auto value = inputs[i]->try_next()) {
+        out_pipe->push(std::move(*value));
+        forwarded = true;
+      } else if (inputs[i]->is_closed()) {
+        inputs.erase(inputs.begin() + i);
+        continue;
+      }
+      i++;
+    }
+    if (forwarded || inputs.empty()) { continue; }
+
+    keep_alive.clear();
+    auto wake = round->rearm();
+    for (const auto& input : inputs) {
+      select_source<std::shared_ptr<Pipe<T>>>::watch(
+        input, round, unused, keep_alive);
+    }
+    co_await wake;
+  }
+  out_pipe->close();
+}
+
+} // namespace details
+
+template <class T>
+std::shared_ptr<Pipe<T>> merge(std::vector<std::shared_ptr<Pipe<T>>> inputs)
+{
+  auto out_pipe = Pipe<T>::create();
+  async::schedule_task(details::merge_into<T>, std::move(inputs), out_pipe);
+  return out_pipe;
+}
+
+} // namespace async
@@ -0,0 +1,147 @@
+#include "select.hpp"
+
+#include <string>
+
+#include "testing.hpp"
+
+namespace async {
+namespace {
+
+ASYNC_TEST(first_ready_pipe_wins)
+{
+  auto ints = Pipe<int>::create();
+  auto strings = Pipe<std::string>::create();
+
+  strings->push("hello");
+  auto result = co_await select(ints, strings);
+  P("index: $ value: $", result.index(), *std::get<1>(result));
+
+  // Both are ready, the first one wins and the other keeps its value
+  ints->push(1);
+  strings->push("world");
+  result = co_await select(ints, strings);
+  P("index: $ value: $", result.index(), *std::get<0>(result));
+  P("left in strings: $", *strings->try_next());
+}
+
+ASYNC_TEST(waits_for_any_source)
+{
+  auto pipe = Pipe<int>::create();
+
+  auto result = co_await select(pipe, after(bee::Span::of_millis(5)));
+  P("index: $", result.index());
+
+  auto slow = [&]() -> Task<int> {
+    co_await after(bee::Span::of_millis(5));
+    co_return 42;
+  };
+  auto push_later = [&]() -> Task<> {
+    co_await after(bee::Span::of_millis(1));
+    pipe->push(7);
+  };
+  auto pusher = push_later();
+  auto task = slow();
+
+  auto result2 = co_await select(pipe, task);
+  P("index: $ value: $", result2.index(), *std::get<0>(result2));
+
+  // The task that lost is still intact
+  P("task: $", co_await task);
+  co_await pusher;
+}
+
+ASYNC_TEST(losing_sources_can_be_awaited)
+{
+  auto pipe = Pipe<int>::create();
+  auto ivar = Ivar<int>::create();
+  auto deferred = ivar_value(ivar);
+
+  auto task_ivar = Ivar<int>::create();
+  auto other_task_ivar = Ivar<int>::create();
+  auto wait_for = [](Ivar<int>::ptr ivar) -> Task<int> {
+    co_return co_await ivar;
+  };
+  auto task = wait_for(task_ivar);
+  auto other_task = wait_for(other_task_ivar);
+
+  // Nothing is ready yet, so the select watches every source before the pipe
+  // wins
+  auto selected = select(pipe, deferred, task, other_task);
+  pipe->push(1);
+  auto result = co_await selected;
+  P("index: $ value: $", result.index(), *std::get<0>(result));
+
+  auto fill_later = [&]() -> Task<> {
+    co_await after(bee::Span::of_millis(1));
+    ivar->fill(2);
+    task_ivar->fill(3);
+    other_task_ivar->fill(4);
+  };
+  auto filler = fill_later();
+
+  auto other_deferred = other_task.to_deferred();
+  P("deferred: $", co_await deferred);
+  P("task: $", co_await task);
+  P("task as deferred: $", co_await other_deferred);
+  co_await filler;
+}
+
+ASYNC_TEST(closed_pipe)
+{
+  auto pipe = Pipe<int>::create();
+  auto other = Pipe<int>::create();
+
+  auto close_later = [&]() -> Task<> {
+    co_await after(bee::Span::of_millis(1));
+    pipe->close();
+  };
+  auto closer = close_later();
+
+  auto result = co_await select(other, pipe);
+  P("index: $ has_value: $", result.index(), std::get<1>(result).has_value());
+  co_await closer;
+}
+
+ASYNC_TEST(select_vector)
+{
+  std::vector<Pipe<int>::ptr> pipes;
+  for (int i = 0; i < 3; i++) { pipes.push_back(Pipe<int>::create()); }
+
+  auto push_later = [&]() -> Task<> {
+    co_await after(bee::Span::of_millis(1));
+    pipes[2]->push(5);
+  };
+  auto pusher = push_later();
+
+  auto [index, value] = co_await select(pipes);
+  P("index: $ value: $", index, *value);
+  co_await pusher;
+}
+
+ASYNC_TEST(merge)
+{
+  auto p1 = Pipe<int>::create();
+  auto p2 = Pipe<int>::create();
+
+  auto merged = merge(std::vector<Pipe<int>::ptr>{p1, p2});
+  auto task =
+    schedule_task([&]() { return merged->iter([](int v) { P(v); }); });
+
+  for (int i = 0; i < 3; i++) { p1->push(i); }
+  p2->push(10);
+  p2->push(11);
+  p1->close();
+
+  auto push_later = [&]() -> Task<> {
+    co_await after(bee::Span::of_millis(1));
+    p2->push(12);
+    p2->close();
+  };
+  co_await push_later();
+
+  co_await task;
+  P("closed: $", merged->is_closed());
+}
+
+} // namespace
+} // namespace async
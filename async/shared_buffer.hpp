@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "bee/data_buffer.hpp"
+
+namespace async {
+
+// Immutable bytes with shared ownership. Copies and slices point to the same
+// storage, so one payload can be queued on many AsyncFDs at once and is freed
+// once the last of them has sent it.
+struct SharedBuffer {
+ public:
+  SharedBuffer() = default;
+
+  explicit SharedBuffer(bee::DataBuffer&& data)
+      : _storage(std::make_shared<const bee::DataBuffer>(std::move(data))),
+        _size(_storage->size())
+  {}
+
+  explicit SharedBuffer(std::string&& data)
+      : SharedBuffer(to_data_buffer(std::move(data)))
+  {}
+
+  explicit SharedBuffer(const std::string& data)
+      : SharedBuffer(to_data_buffer(data))
+  {}
+
+  size_t size() const { return _size; }
+
+  bool empty() const { return _size == 0; }
+
+  SharedBuffer slice(size_t offset, size_t length) const
+  {
+    assert(offset + length <= _size);
+    SharedBuffer output;
+    output._storage = _storage;
+    output._offset = _offset + offset;
+    output._size = length;
+    return output;
+  }
+
+  // The whole underlying buffer, the slice starts at offset() in it
+  const std::shared_ptr<const bee::DataBuffer>& storage() const
+  {
+    return _storage;
+  }
+
+  size_t offset() const { return _offset; }
+
+  std::string to_string() const
+  {
+    std::string output;
+    if (_storage == nullptr) { return output; }
+    size_t skip = _offset;
+    for (const auto& block : *_storage) {
+      if (output.size() == _size) { break; }
+      if (block.size() <= skip) {
+        skip -= block.size();
+        continue;
+      }
+      size_t length = std::min(block.size() - skip, _size - output.size());
+      output.append(
+        reinterpret_cast<const char*>(block.data()) + skip, length);
+      skip = 0;
+    }
+    return output;
+  }
+
+ private:
+  template <class T> static bee::DataBuffer to_data_buffer(T&& data)
+  {
+    bee::DataBuffer output;
+    output.write(std::forward<T>(data));
+    return output;
+  }
+
+  std::shared_ptr<const bee::DataBuffer> _storage;
+  size_t _offset = 0;
+  size_t _size = 0;
+};
+
+} // namespace async
@@ -1,14 +1,18 @@
 #include "socket.hpp"
 
+#include <algorithm>
 #include <cerrno>
 
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
+#include "scheduler_context.hpp"
+
 #include "bee/fd.hpp"
 #include "bee/util.hpp"
 
@@ -32,6 +36,8 @@ namespace async {
 
 namespace {
 
+constexpr size_t recv_buffer_size = 64 * 1024;
+
 bee::OrError<FD::shared_ptr> create_socket_fd(int family)
 {
   int fd = socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
@@ -39,6 +45,70 @@ bee::OrError<FD::shared_ptr> create_socket_fd(int family)
   return FD(fd).to_shared();
 }
 
+socklen_t socket_address(const IP& ip, int port, sockaddr_storage& address)
+{
+  memset(&address, 0, sizeof(address));
+  return visit(
+    [&](const auto& ip) -> socklen_t {
+      using T = decay_t<decltype(ip)>;
+      if constexpr (is_same_v<T, IPV4>) {
+        auto addr = (sockaddr_in*)&address;
+        addr->sin_addr.s_addr = ip.address;
+        addr->sin_family = AF_INET;
+        addr->sin_port = htons(port);
+        return sizeof(sockaddr_in);
+      } else if constexpr (is_same_v<T, IPV6>) {
+        auto addr = (sockaddr_in6*)&address;
+        addr->sin6_family = AF_INET6;
+        addr->sin6_port = htons(port);
+        memcpy(addr->sin6_addr.s6_addr, ip.address, sizeof(ip.address));
+        return sizeof(sockaddr_in6);
+      } else {
+        static_assert(bee::always_false_v<T> && "non exaustive visit");
+      }
+    },
+    ip);
+}
+
+bee::OrError<> enable_fast_open(const FD& fd)
+{
+#ifdef TCP_FASTOPEN_CONNECT
+  int value = 1;
+  if (
+    setsockopt(
+      fd.int_fd(),
+      IPPROTO_TCP,
+      TCP_FASTOPEN_CONNECT,
+      &value,
+      sizeof(value)) < 0 &&
+    errno != ENOPROTOOPT) {
+    shot("Failed to enable TCP fast open: $", strerror(errno));
+  }
+#else
+  (void)fd;
+#endif
+  return bee::ok();
+}
+
+// Result of a connect that was in progress once the socket is writable
+bee::OrError<> connect_result(const FD& fd)
+{
+  int error = 0;
+  socklen_t len = sizeof(error);
+  if (getsockopt(fd.int_fd(), SOL_SOCKET, SO_ERROR, &error, &len) < 0) {
+    shot("Failed to get socket error: $", strerror(errno));
+  }
+  if (error != 0) { shot("Failed to connect to host: $", strerror(error)); }
+  return bee::ok();
+}
+
+bool is_connected(const FD& fd)
+{
+  sockaddr_storage address;
+  socklen_t len = sizeof(address);
+  return getpeername(fd.int_fd(), (sockaddr*)&address, &len) == 0;
+}
+
 } // namespace
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -158,46 +228,66 @@ SocketClient::SocketClient(AsyncFD::ptr&& fd) : _fd(std::move(fd)) {}
 
 const AsyncFD::ptr& SocketClient::fd() const { return _fd; }
 
-bee::OrError<SocketClient::ptr> SocketClient::connect(const IP& ip, int port)
+Task<bee::OrError<SocketClient::ptr>> SocketClient::connect(IP ip, int port)
 {
-  sockaddr_in serv_addr_v4;
-  sockaddr_in6 serv_addr_v6;
+  return connect(std::move(ip), port, ConnectOptions());
+}
 
-  size_t addr_len;
+Task<bee::OrError<SocketClient::ptr>> SocketClient::connect(
+  IP ip, int port, bee::Span timeout)
+{
+  return connect(std::move(ip), port, ConnectOptions{.timeout = timeout});
+}
 
-  auto serv_addr = visit(
-    [&](const auto& ip) {
-      using T = decay_t<decltype(ip)>;
-      if constexpr (is_same_v<T, IPV4>) {
-        serv_addr_v4.sin_addr.s_addr = ip.address;
-        serv_addr_v4.sin_family = AF_INET;
-        serv_addr_v4.sin_port = htons(port);
-        addr_len = sizeof(serv_addr_v4);
-        return (sockaddr*)&serv_addr_v4;
-      } else if constexpr (is_same_v<T, IPV6>) {
-        serv_addr_v6.sin6_family = AF_INET6;
-        serv_addr_v6.sin6_port = htons(port);
-        memcpy(serv_addr_v6.sin6_addr.s6_addr, ip.address, sizeof(ip.address));
-        addr_len = sizeof(serv_addr_v6);
-        return (sockaddr*)&serv_addr_v6;
-      } else {
-        static_assert(bee::always_false_v<T> && "non exaustive visit");
-      }
-    },
-    ip);
+Task<bee::OrError<SocketClient::ptr>> SocketClient::connect(
+  IP ip, int port, ConnectOptions options)
+{
+  sockaddr_storage address;
+  socklen_t addr_len = socket_address(ip, port, address);
 
-  bail(fd, create_socket_fd(serv_addr->sa_family));
+  co_bail(fd, create_socket_fd(address.ss_family));
+  co_bail_unit(fd->set_blocking(false));
+  if (options.fast_open) { co_bail_unit(enable_fast_open(*fd)); }
 
-  int ret = ::connect(fd->int_fd(), serv_addr, addr_len);
-  if (ret != 0) {
-    shot("Failed to connect to host (fd:$): $", fd->int_fd(), strerror(errno));
+  int ret = ::connect(fd->int_fd(), (sockaddr*)&address, addr_len);
+  if (ret != 0 && errno != EINPROGRESS) {
+    co_return bee::Error::fmt(
+      "Failed to connect to host (fd:$): $", fd->int_fd(), strerror(errno));
   }
 
-  bail_unit(fd->set_blocking(false));
+  co_bail(afd, AsyncFD::of_fd(fd, true));
+  if (ret != 0) {
+    // The timer may not be cancellable, so it checks whether it's still needed
+    auto waiting = std::make_shared<bool>(true);
+    optional<TimedTaskId> timer;
+    if (options.timeout.has_value()) {
+      timer = async::after(*options.timeout, [waiting, weak = weak_ptr(afd)]() {
+        if (!*waiting) { return; }
+        if (auto afd = weak.lock()) { afd->close(); }
+      });
+    }
 
-  bail(afd, AsyncFD::of_fd(std::move(fd), true));
+    bee::OrError<> result = bee::ok();
+    while (true) {
+      co_await afd->wait_writable();
+      if (afd->is_closed()) {
+        result = bee::Error::fmt(
+          "Timed out connecting to host after $", *options.timeout);
+        break;
+      }
+      result = connect_result(*fd);
+      if (result.is_error() || is_connected(*fd)) { break; }
+    }
+
+    *waiting = false;
+    if (timer.has_value()) { async::cancel(*timer); }
+    if (result.is_error()) {
+      afd->close();
+      co_return std::move(result.error());
+    }
+  }
 
-  return of_fd(std::move(afd));
+  co_return of_fd(std::move(afd));
 }
 
 bee::OrError<> SocketClient::send(bee::DataBuffer&& data)
@@ -210,6 +300,28 @@ bee::OrError<> SocketClient::send(string&& data)
   return _fd->write(std::move(data));
 }
 
+bee::OrError<> SocketClient::send(const SharedBuffer& data)
+{
+  return _fd->write(data);
+}
+
+Task<bee::OrError<>> SocketClient::send_async(bee::DataBuffer data)
+{
+  co_bail_unit(co_await _fd->writable());
+  co_return _fd->write(std::move(data));
+}
+
+Task<bee::OrError<>> SocketClient::send_async(string data)
+{
+  co_bail_unit(co_await _fd->writable());
+  co_return _fd->write(std::move(data));
+}
+
+void SocketClient::set_write_watermarks(size_t high, size_t low)
+{
+  _fd->set_write_watermarks(high, low);
+}
+
 SocketClient::ptr SocketClient::of_fd(AsyncFD::ptr&& fd)
 {
   auto sock = ptr(new SocketClient(bee::copy(fd)));
@@ -262,7 +374,10 @@ bool SocketClient::close()
   if (is_closed()) { return false; }
   _closed = true;
   auto ret = _fd->close();
-  if (!_is_in_data_callback) { _data_callback = nullptr; }
+  if (!_is_in_data_callback) {
+    _data_callback = nullptr;
+    _pooled_data_callback = nullptr;
+  }
   return ret;
 }
 
@@ -282,29 +397,143 @@ void SocketClient::_call_data_callback(bee::OrError<bee::DataBuffer>&& buf)
   if (is_closed()) { _data_callback = nullptr; }
 }
 
-void SocketClient::_on_ready()
+void SocketClient::_call_pooled_data_callback(bee::OrError<PooledBuffer>&& buf)
 {
   if (is_closed()) { return; }
+  assert(!_is_in_data_callback);
+  _is_in_data_callback = true;
+  _pooled_data_callback(std::move(buf));
+  _is_in_data_callback = false;
+  if (is_closed()) { _pooled_data_callback = nullptr; }
+}
+
+void SocketClient::_report_read_error(bee::Error&& error)
+{
+  if (_pooled_data_callback != nullptr) {
+    _call_pooled_data_callback(std::move(error));
+  } else {
+    _call_data_callback(std::move(error));
+  }
+  close();
+}
+
+void SocketClient::_on_ready()
+{
+  if (is_closed() || _reading_paused) { return; }
+  // Left in the kernel until a callback is set
+  if (_pooled_data_callback != nullptr) {
+    _read_into_slabs();
+  } else if (_data_callback != nullptr) {
+    _read_into_buffer();
+  }
+}
+
+void SocketClient::_read_into_buffer()
+{
+  if (_recv_buffer.empty()) { _recv_buffer.resize(recv_buffer_size); }
+
   bee::DataBuffer buf;
-  auto result_or_error = _fd->read(buf);
-  if (result_or_error.is_error()) {
-    _call_data_callback(result_or_error.error());
-    close();
-    return;
+  bool eof = false;
+  bool budget_exhausted = false;
+  while (true) {
+    if (buf.size() >= _read_budget) {
+      budget_exhausted = true;
+      break;
+    }
+    size_t to_read = std::min(_recv_buffer.size(), _read_budget - buf.size());
+    auto result_or_error = _fd->read_some(_recv_buffer.data(), to_read);
+    if (result_or_error.is_error()) {
+      _report_read_error(std::move(result_or_error.error()));
+      return;
+    }
+    auto& result = result_or_error.value();
+    if (!result.has_value()) { break; }
+    if (*result == 0) {
+      eof = true;
+      break;
+    }
+    buf.write(_recv_buffer.data(), *result);
   }
 
-  auto& result = result_or_error.value();
-  if (result.bytes_read() > 0) { _call_data_callback(std::move(buf)); }
-  if (result.is_eof()) {
+  if (!buf.empty()) { _call_data_callback(std::move(buf)); }
+  if (eof) {
     _call_data_callback(bee::DataBuffer());
     close();
+  } else if (budget_exhausted) {
+    // Epoll is edge triggered, so nothing would tell us about the data that
+    // is left
+    _schedule_read();
+  }
+}
+
+void SocketClient::_read_into_slabs()
+{
+  size_t bytes_read = 0;
+  while (bytes_read < _read_budget) {
+    auto result_or_error = _fd->read_pooled(_read_budget - bytes_read);
+    if (result_or_error.is_error()) {
+      _report_read_error(std::move(result_or_error.error()));
+      return;
+    }
+    auto& result = result_or_error.value();
+    if (!result.has_value()) { return; }
+    if (result->empty()) {
+      _call_pooled_data_callback(PooledBuffer());
+      close();
+      return;
+    }
+    bytes_read += result->size();
+    _call_pooled_data_callback(std::move(*result));
+    // Whatever is left stays in the kernel until resume_reading()
+    if (is_closed() || _reading_paused) { return; }
   }
+  _schedule_read();
+}
+
+void SocketClient::_schedule_read()
+{
+  if (_read_scheduled) { return; }
+  _read_scheduled = true;
+  schedule([weak = weak_from_this()]() {
+    if (auto ptr = weak.lock()) {
+      ptr->_read_scheduled = false;
+      ptr->_on_ready();
+    }
+  });
+}
+
+void SocketClient::pause_reading() { _reading_paused = true; }
+
+void SocketClient::resume_reading()
+{
+  if (!_reading_paused) { return; }
+  _reading_paused = false;
+  _schedule_read();
+}
+
+bool SocketClient::is_reading_paused() const { return _reading_paused; }
+
+void SocketClient::set_read_budget(size_t bytes)
+{
+  assert(bytes > 0);
+  _read_budget = bytes;
 }
 
 void SocketClient::set_data_callback(data_callback&& data_callback)
 {
   assert(_data_callback == nullptr && "Data callback already set");
+  assert(_pooled_data_callback == nullptr && "Data callback already set");
   _data_callback = std::move(data_callback);
+  // Data may have arrived before, e.g. while connect was resuming the caller
+  _schedule_read();
+}
+
+void SocketClient::set_pooled_data_callback(pooled_data_callback&& callback)
+{
+  assert(_data_callback == nullptr && "Data callback already set");
+  assert(_pooled_data_callback == nullptr && "Data callback already set");
+  _pooled_data_callback = std::move(callback);
+  _schedule_read();
 }
 
 Task<bee::OrError<>> SocketClient::flushed() { return _fd->flushed(); }
@@ -1,13 +1,18 @@
 #pragma once
 
 #include <memory>
+#include <optional>
+#include <vector>
 
 #include "async_fd.hpp"
+#include "receive_buffer_pool.hpp"
+#include "shared_buffer.hpp"
 #include "task.hpp"
 
 #include "bee/data_buffer.hpp"
 #include "bee/error.hpp"
 #include "bee/fd.hpp"
+#include "bee/span.hpp"
 
 namespace async {
 
@@ -28,15 +33,42 @@ struct SocketClient : public std::enable_shared_from_this<SocketClient> {
   using data_callback =
     std::function<void(bee::OrError<bee::DataBuffer>&& buf)>;
 
+  using pooled_data_callback =
+    std::function<void(bee::OrError<PooledBuffer>&& buf)>;
+
+  struct ConnectOptions {
+    // Without a timeout, the kernel gives up on its own after its SYN
+    // retries, which takes minutes
+    std::optional<bee::Span> timeout;
+
+    // Uses TCP Fast Open where the kernel supports it. With a cookie cached
+    // for the peer, connect completes right away and the first send goes out
+    // with the SYN, so the timeout doesn't cover the handshake. Without one,
+    // it's a regular handshake that fetches a cookie for the next time.
+    bool fast_open = false;
+  };
+
   SocketClient(const SocketClient&) = delete;
   SocketClient(SocketClient&&) = default;
 
   ~SocketClient();
 
-  static bee::OrError<ptr> connect(const IP& ip, int port);
+  // Doesn't block, completes once the handshake is done or failed
+  static Task<bee::OrError<ptr>> connect(IP ip, int port);
+  static Task<bee::OrError<ptr>> connect(IP ip, int port, bee::Span timeout);
+  static Task<bee::OrError<ptr>> connect(
+    IP ip, int port, ConnectOptions options);
 
   bee::OrError<> send(std::string&& data);
   bee::OrError<> send(bee::DataBuffer&& data);
+  bee::OrError<> send(const SharedBuffer& data);
+
+  // Sends once the outgoing buffer is below the write watermarks, see
+  // AsyncFD::set_write_watermarks
+  Task<bee::OrError<>> send_async(std::string data);
+  Task<bee::OrError<>> send_async(bee::DataBuffer data);
+
+  void set_write_watermarks(size_t high, size_t low);
 
   static bee::OrError<IP> resolve_host(const std::string& hostname);
 
@@ -50,24 +82,56 @@ struct SocketClient : public std::enable_shared_from_this<SocketClient> {
 
   static ptr of_fd(AsyncFD::ptr&& fd);
 
+  // Each call gets a new DataBuffer, the data is copied into it out of a
+  // receive buffer owned by the client
   void set_data_callback(data_callback&& data_callback);
 
+  // Alternative to set_data_callback that hands over the receive slabs
+  // instead of copying them into a DataBuffer. Each call gets one slab of the
+  // scheduler's receive pool, which goes back to it once released. An empty
+  // buffer means EOF.
+  void set_pooled_data_callback(pooled_data_callback&& callback);
+
   Task<bee::OrError<>> flushed();
 
+  // While paused, incoming data is left in the kernel buffer and the data
+  // callback isn't called
+  void pause_reading();
+  void resume_reading();
+
+  bool is_reading_paused() const;
+
+  // Maximum number of bytes read per wakeup, the rest is read in a later task
+  // so other sockets get their turn
+  void set_read_budget(size_t bytes);
+
  private:
   explicit SocketClient(AsyncFD::ptr&& fd);
 
   void _on_ready();
+  void _read_into_buffer();
+  void _read_into_slabs();
+  void _schedule_read();
 
   void _call_data_callback(bee::OrError<bee::DataBuffer>&& buf);
+  void _call_pooled_data_callback(bee::OrError<PooledBuffer>&& buf);
+  void _report_read_error(bee::Error&& error);
 
   AsyncFD::ptr _fd;
 
   data_callback _data_callback;
+  pooled_data_callback _pooled_data_callback;
 
   bool _is_in_data_callback = false;
 
   bool _closed = false;
+
+  bool _reading_paused = false;
+  bool _read_scheduled = false;
+  size_t _read_budget = 256 * 1024;
+
+  // Reused by every read, data is copied out of it for the data callback
+  std::vector<std::byte> _recv_buffer;
 };
 
 struct SocketServer {
@@ -1,9 +1,18 @@
+#include <algorithm>
 #include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
 
 #include "deferred_awaitable.hpp"
 #include "socket.hpp"
 #include "testing.hpp"
 
+#include "bee/fd.hpp"
 #include "bee/util.hpp"
 
 using namespace async;
@@ -28,7 +37,7 @@ ASYNC_TEST(basic)
   must(port, server->port());
 
   must(ip, SocketClient::resolve_host("localhost"));
-  must(client, SocketClient::connect(ip, port));
+  must(client, co_await SocketClient::connect(ip, port));
 
   auto done = Ivar<>::create();
 
@@ -70,7 +79,7 @@ ASYNC_TEST(send_data_buffer)
   must(port, server->port());
 
   must(ip, SocketClient::resolve_host("localhost"));
-  must(client, SocketClient::connect(ip, port));
+  must(client, co_await SocketClient::connect(ip, port));
 
   auto done = Ivar<>::create();
 
@@ -91,5 +100,377 @@ ASYNC_TEST(send_data_buffer)
   client->close();
 }
 
+ASYNC_TEST(pause_and_read_budget)
+{
+  constexpr size_t total = 100000;
+  constexpr size_t budget = 16 * 1024;
+  must(
+    server,
+    SocketServer::listen(
+      nullopt, [](bee::OrError<SocketClient::ptr>&& sock_or_error) -> Task<> {
+        must(sock, sock_or_error);
+        must_unit(sock->send(std::string(total, 'x')));
+        co_await sock->flushed();
+        sock->close();
+      }));
+
+  must(port, server->port());
+
+  must(ip, SocketClient::resolve_host("localhost"));
+  must(client, co_await SocketClient::connect(ip, port));
+  client->set_read_budget(budget);
+  client->pause_reading();
+
+  auto done = Ivar<>::create();
+  size_t received = 0;
+  size_t max_chunk = 0;
+  int chunks = 0;
+
+  client->set_data_callback(
+    [&, done](bee::OrError<bee::DataBuffer>&& buf_or_error) {
+      must(buf, buf_or_error);
+      if (buf.empty()) {
+        done->fill();
+      } else {
+        received += buf.size();
+        max_chunk = std::max(max_chunk, buf.size());
+        chunks++;
+      }
+    });
+
+  co_await after(bee::Span::of_millis(20));
+  P("Received while paused: $", received);
+
+  client->resume_reading();
+  co_await done;
+  P("Received: $", received);
+  P("Chunks within budget: $", max_chunk <= budget);
+  P("Took several wakeups: $", chunks >= int(total / budget));
+
+  server->close();
+  client->close();
+}
+
+ASYNC_TEST(zerocopy)
+{
+  constexpr size_t block_size = 1024 * 1024;
+  must(
+    server,
+    SocketServer::listen(
+      nullopt, [](bee::OrError<SocketClient::ptr>&& sock_or_error) -> Task<> {
+        must(sock, sock_or_error);
+        must_unit(sock->fd()->enable_zerocopy(64 * 1024));
+        must_unit(sock->send("header;"));
+        for (int i = 0; i < 4; i++) {
+          bee::DataBuffer buffer;
+          buffer.write(std::string(block_size, 'a' + i));
+          must_unit(sock->send(std::move(buffer)));
+        }
+        must_unit(co_await sock->flushed());
+        P("In flight after flush: $", sock->fd()->zerocopy_in_flight());
+        sock->close();
+      }));
+
+  must(port, server->port());
+
+  must(ip, SocketClient::resolve_host("localhost"));
+  must(client, co_await SocketClient::connect(ip, port));
+
+  auto done = Ivar<>::create();
+  std::string received;
+
+  client->set_data_callback(
+    [&, done](bee::OrError<bee::DataBuffer>&& buf_or_error) {
+      must(buf, buf_or_error);
+      if (buf.empty()) {
+        done->fill();
+      } else {
+        received += buf.to_string();
+      }
+    });
+
+  co_await done;
+  std::string expected = "header;";
+  for (int i = 0; i < 4; i++) { expected += std::string(block_size, 'a' + i); }
+  P("Received: $", received.size());
+  P("Matches: $", received == expected);
+
+  server->close();
+  client->close();
+}
+
+ASYNC_TEST(zerocopy_close_then_reuse)
+{
+  constexpr size_t block_size = 64 * 1024;
+  constexpr int num_blocks = 32;
+  auto server_done = Ivar<>::create();
+  must(
+    server,
+    SocketServer::listen(
+      nullopt,
+      [server_done](bee::OrError<SocketClient::ptr>&& sock_or_error) -> Task<> {
+        must(sock, sock_or_error);
+        must_unit(sock->fd()->enable_zerocopy(block_size));
+        bee::DataBuffer buffer;
+        for (int i = 0; i < num_blocks; i++) {
+          buffer.write(std::string(block_size, 'a' + i % 26));
+        }
+        must_unit(sock->send(std::move(buffer)));
+        sock->close();
+        // Likely to get the memory of the buffer that was just sent
+        std::vector<std::string> reused;
+        for (int i = 0; i < num_blocks; i++) {
+          reused.push_back(std::string(block_size, 'x'));
+        }
+        server_done->fill();
+        co_return;
+      }));
+
+  must(port, server->port());
+
+  must(ip, SocketClient::resolve_host("localhost"));
+  must(client, co_await SocketClient::connect(ip, port));
+  client->pause_reading();
+
+  auto done = Ivar<>::create();
+  std::string received;
+
+  client->set_data_callback(
+    [&, done](bee::OrError<bee::DataBuffer>&& buf_or_error) {
+      must(buf, buf_or_error);
+      if (buf.empty()) {
+        done->fill();
+      } else {
+        received += buf.to_string();
+      }
+    });
+
+  co_await server_done;
+  client->resume_reading();
+  co_await done;
+
+  std::string expected;
+  for (int i = 0; i < num_blocks; i++) {
+    expected += std::string(block_size, 'a' + i % 26);
+  }
+  P("Received data: $", !received.empty());
+  P("Intact: $", expected.starts_with(received));
+
+  server->close();
+  client->close();
+}
+
+ASYNC_TEST(pooled_data_callback)
+{
+  constexpr size_t total = 200000;
+  auto pool = ReceiveBufferPool::create({.slab_size = 16 * 1024});
+  set_receive_buffer_pool(pool);
+  must(
+    server,
+    SocketServer::listen(
+      nullopt, [](bee::OrError<SocketClient::ptr>&& sock_or_error) -> Task<> {
+        must(sock, sock_or_error);
+        must_unit(sock->send(std::string(total, 'x')));
+        co_await sock->flushed();
+        sock->close();
+      }));
+
+  must(port, server->port());
+
+  must(ip, SocketClient::resolve_host("localhost"));
+  must(client, co_await SocketClient::connect(ip, port));
+
+  auto done = Ivar<>::create();
+  std::vector<PooledBuffer> held;
+
+  client->set_pooled_data_callback(
+    [&, done](bee::OrError<PooledBuffer>&& buf_or_error) {
+      must(buf, std::move(buf_or_error));
+      if (buf.empty()) {
+        done->fill();
+      } else {
+        held.push_back(std::move(buf));
+      }
+    });
+
+  co_await done;
+  size_t received = 0;
+  for (const auto& buf : held) { received += buf.size(); }
+  P("Received: $", received);
+  P("Slab size: $", held.front().capacity());
+  P("Held slabs in use: $", pool->stats().slabs_in_use == held.size());
+  held.clear();
+  P("In use after release: $", pool->stats().slabs_in_use);
+
+  server->close();
+  client->close();
+}
+
+ASYNC_TEST(zerocopy_close_timeout)
+{
+  constexpr size_t block_size = 64 * 1024;
+  auto server_fd = Ivar<int>::create();
+  must(
+    server,
+    SocketServer::listen(
+      nullopt,
+      [server_fd](bee::OrError<SocketClient::ptr>&& sock_or_error) -> Task<> {
+        must(sock, sock_or_error);
+        must_unit(
+          sock->fd()->enable_zerocopy(block_size, bee::Span::of_millis(100)));
+        bee::DataBuffer buffer;
+        for (int i = 0; i < 64; i++) {
+          buffer.write(std::string(block_size, 'z'));
+        }
+        must_unit(sock->send(std::move(buffer)));
+        int fd = sock->fd()->int_fd();
+        sock->close();
+        server_fd->fill(fd);
+        co_return;
+      }));
+
+  must(port, server->port());
+
+  must(ip, SocketClient::resolve_host("localhost"));
+  must(client, co_await SocketClient::connect(ip, port));
+  // Nothing is read, so the sends that don't fit are never released
+  client->pause_reading();
+
+  int fd = co_await server_fd;
+  P("Open while sends are in flight: $", fcntl(fd, F_GETFD) != -1);
+  co_await after(bee::Span::of_millis(300));
+  P("Closed after the timeout: $", fcntl(fd, F_GETFD) == -1);
+
+  server->close();
+  client->close();
+}
+
+ASYNC_TEST(data_callback_skips_pool)
+{
+  constexpr size_t total = 1000000;
+  auto pool = ReceiveBufferPool::create(ReceiveBufferPool::Options());
+  set_receive_buffer_pool(pool);
+  must(
+    server,
+    SocketServer::listen(
+      nullopt, [](bee::OrError<SocketClient::ptr>&& sock_or_error) -> Task<> {
+        must(sock, sock_or_error);
+        must_unit(sock->send(std::string(total, 'x')));
+        co_await sock->flushed();
+        sock->close();
+      }));
+
+  must(port, server->port());
+
+  must(ip, SocketClient::resolve_host("localhost"));
+  must(client, co_await SocketClient::connect(ip, port));
+
+  auto done = Ivar<>::create();
+  size_t received = 0;
+
+  client->set_data_callback(
+    [&, done](bee::OrError<bee::DataBuffer>&& buf_or_error) {
+      must(buf, buf_or_error);
+      if (buf.empty()) {
+        done->fill();
+      } else {
+        received += buf.size();
+      }
+    });
+
+  co_await done;
+  P("Received: $", received);
+  P("Peak slabs in use: $", pool->stats().peak_slabs_in_use);
+
+  server->close();
+  client->close();
+}
+
+ASYNC_TEST(connect_refused)
+{
+  must(
+    server,
+    SocketServer::listen(
+      nullopt, [](bee::OrError<SocketClient::ptr>&&) -> Task<> { co_return; }));
+  must(port, server->port());
+  server->close();
+
+  must(ip, SocketClient::resolve_host("localhost"));
+  auto client = co_await SocketClient::connect(ip, port);
+  P("Refused: $", client.is_error());
+}
+
+ASYNC_TEST(connect_timeout)
+{
+  // With a backlog of zero the kernel queues one connection and drops the
+  // SYNs after that, so the second connect never completes
+  int listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  bee::FD listener(listen_fd);
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (
+    ::bind(listen_fd, (sockaddr*)&address, sizeof(address)) != 0 ||
+    ::listen(listen_fd, 0) != 0) {
+    P("Failed to listen: $", strerror(errno));
+    co_return;
+  }
+  socklen_t len = sizeof(address);
+  getsockname(listen_fd, (sockaddr*)&address, &len);
+  int port = ntohs(address.sin_port);
+
+  auto ip = IPV4{htonl(INADDR_LOOPBACK)};
+  auto timeout = bee::Span::of_millis(200);
+  must(first, co_await SocketClient::connect(ip, port, timeout));
+  auto second = co_await SocketClient::connect(ip, port, timeout);
+  P("Second timed out: $", second.is_error());
+  first->close();
+}
+
+ASYNC_TEST(connect_fast_open)
+{
+  must(
+    server,
+    SocketServer::listen(
+      nullopt, [](bee::OrError<SocketClient::ptr>&& sock_or_error) -> Task<> {
+        must(sock, sock_or_error);
+        sock->set_data_callback([sock](bee::OrError<bee::DataBuffer>&& buf) {
+          must(data, buf);
+          if (data.empty()) {
+            sock->close();
+          } else {
+            must_unit(sock->send(std::move(data)));
+          }
+        });
+        co_return;
+      }));
+  must(port, server->port());
+  must(ip, SocketClient::resolve_host("localhost"));
+
+  SocketClient::ConnectOptions options{
+    .timeout = bee::Span::of_seconds(5),
+    .fast_open = true,
+  };
+  // The second connection can use the cookie fetched by the first
+  for (int i = 0; i < 2; i++) {
+    must(client, co_await SocketClient::connect(ip, port, options));
+    auto done = Ivar<>::create();
+    std::string received;
+    client->set_data_callback(
+      [&, done](bee::OrError<bee::DataBuffer>&& buf_or_error) {
+        must(buf, buf_or_error);
+        received += buf.to_string();
+        if (received.size() == 5) { done->fill(); }
+      });
+    must_unit(client->send("hello"));
+    co_await done;
+    P("Echoed: $", received);
+    client->close();
+  }
+
+  server->close();
+}
+
 } // namespace
 } // namespace async
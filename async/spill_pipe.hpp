@@ -0,0 +1,297 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <concepts>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <unistd.h>
+
+#include "async.hpp"
+#include "deferred_awaitable.hpp"
+#include "task.hpp"
+
+#include "bee/error.hpp"
+#include "bee/fd.hpp"
+
+namespace async {
+
+////////////////////////////////////////////////////////////////////////////////
+// SpillCodec
+//
+// Turns values into bytes for the spill file. Provided for trivially copyable
+// types and std::string, other types can specialize it or pass their own codec
+// to SpillPipe.
+//
+
+template <class T> struct SpillCodec;
+
+template <class T>
+  requires std::is_trivially_copyable_v<T>
+struct SpillCodec<T> {
+  static void encode(const T& value, std::string& out)
+  {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  static T decode(const char* data, size_t size)
+  {
+    assert(size == sizeof(T));
+    T value;
+    memcpy(&value, data, sizeof(T));
+    return value;
+  }
+};
+
+template <> struct SpillCodec<std::string> {
+  static void encode(const std::string& value, std::string& out)
+  {
+    out.append(value);
+  }
+
+  static std::string decode(const char* data, size_t size)
+  {
+    return std::string(data, size);
+  }
+};
+
+template <class C, class T>
+concept spill_codec = requires(const T& value, std::string& out) {
+  C::encode(value, out);
+  { C::decode(out.data(), out.size()) } -> std::convertible_to<T>;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// SpillPipe
+//
+// A pipe that keeps at most high_water values in memory. Once that is reached,
+// new values are appended to an unlinked temporary file as length prefixed
+// records and read back, in order, as the consumer catches up. The file is
+// truncated every time it is fully drained.
+//
+// File I/O is done synchronously on the scheduler thread, in chunks, and only
+// while values are spilled.
+//
+
+template <std::move_constructible T, class Codec = SpillCodec<T>>
+  requires spill_codec<Codec, T>
+struct SpillPipe : public std::enable_shared_from_this<SpillPipe<T, Codec>> {
+ public:
+  using ptr = std::shared_ptr<SpillPipe>;
+
+  SpillPipe(const SpillPipe&) = delete;
+  SpillPipe(SpillPipe&&) = delete;
+
+  ~SpillPipe() { close(); }
+
+  // The spill file is created in dir, or in $TMPDIR (falling back to /tmp)
+  // if dir is empty
+  static bee::OrError<ptr> create(size_t high_water, std::string dir = "")
+  {
+    assert(high_water > 0);
+    if (dir.empty()) {
+      const char* tmpdir = getenv("TMPDIR");
+      dir = tmpdir != nullptr && *tmpdir != 0 ? tmpdir : "/tmp";
+    }
+    std::string path = dir + "/async_spill_XXXXXX";
+    int fd = mkstemp(path.data());
+    if (fd == -1) {
+      shot("Failed to create spill file in '$': $", dir, strerror(errno));
+    }
+    unlink(path.c_str());
+    return ptr(new SpillPipe(high_water, bee::FD(fd).to_shared()));
+  }
+
+  template <std::convertible_to<T> U> bee::OrError<> push(U&& value)
+  {
+    assert(!_closed);
+    if (_spilled == 0 && _memory.size() < _high_water) {
+      _memory.emplace_back(std::forward<U>(value));
+    } else {
+      bail_unit(_spill(T(std::forward<U>(value))));
+    }
+    _wake();
+    return bee::ok();
+  }
+
+  // Returns nullopt once the pipe is closed and drained
+  Task<bee::OrError<std::optional<T>>> next_value()
+  {
+    while (true) {
+      if (_memory.empty() && _spilled > 0) { co_bail_unit(_refill()); }
+      if (!_memory.empty()) {
+        std::optional<T> value(std::move(_memory.front()));
+        _memory.pop_front();
+        co_return std::move(value);
+      }
+      if (_closed) { co_return std::optional<T>(); }
+      auto ivar = Ivar<>::create();
+      _waiting.push_back(ivar);
+      co_await ivar;
+    }
+  }
+
+  void close()
+  {
+    if (_closed) { return; }
+    _closed = true;
+    _wake();
+  }
+
+  bool is_closed() const { return _closed; }
+
+  size_t size() const { return _memory.size() + _spilled; }
+
+  size_t spilled() const { return _spilled; }
+
+ private:
+  // Records are buffered and written in chunks of at least this size
+  static constexpr size_t write_chunk = 64 * 1024;
+  static constexpr size_t read_chunk = 64 * 1024;
+
+  // Wide enough that no record can overflow its prefix
+  using length_t = uint64_t;
+
+  SpillPipe(size_t high_water, bee::FD::shared_ptr&& fd)
+      : _high_water(high_water), _fd(std::move(fd))
+  {}
+
+  bee::OrError<> _spill(T&& value)
+  {
+    size_t start = _write_buffer.size();
+    _write_buffer.resize(start + sizeof(length_t));
+    Codec::encode(value, _write_buffer);
+    length_t length = _write_buffer.size() - start - sizeof(length_t);
+    memcpy(_write_buffer.data() + start, &length, sizeof(length_t));
+    _spilled++;
+    if (_write_buffer.size() >= write_chunk) { return _flush_writes(); }
+    return bee::ok();
+  }
+
+  bee::OrError<> _flush_writes()
+  {
+    size_t done = 0;
+    while (done < _write_buffer.size()) {
+      ssize_t ret = pwrite(
+        _fd->int_fd(),
+        _write_buffer.data() + done,
+        _write_buffer.size() - done,
+        _write_offset + done);
+      if (ret < 0) {
+        if (errno == EINTR) { continue; }
+        shot("Failed to write to spill file: $", strerror(errno));
+      }
+      done += ret;
+    }
+    _write_offset += done;
+    _write_buffer.clear();
+    return bee::ok();
+  }
+
+  // Moves up to high_water spilled records back into memory, oldest first
+  bee::OrError<> _refill()
+  {
+    if (_read_offset == _write_offset) {
+      // Everything left is still in the write buffer, skip the file
+      size_t consumed =
+        _decode_records(_write_buffer.data(), _write_buffer.size());
+      _write_buffer.erase(0, consumed);
+    } else {
+      bail_unit(_read_chunk());
+      size_t consumed =
+        _decode_records(_read_buffer.data(), _read_buffer.size());
+      _read_offset += consumed;
+      if (_read_offset == _write_offset) {
+        _read_offset = _write_offset = 0;
+        if (ftruncate(_fd->int_fd(), 0) == -1) {
+          shot("Failed to truncate spill file: $", strerror(errno));
+        }
+      }
+    }
+    return bee::ok();
+  }
+
+  // Reads from _read_offset, making sure at least one whole record is read
+  bee::OrError<> _read_chunk()
+  {
+    size_t available = _write_offset - _read_offset;
+    size_t want = std::min(available, read_chunk);
+    _read_buffer.resize(want);
+    bail_unit(_pread_exact(_read_buffer.data(), want, _read_offset));
+
+    length_t length;
+    memcpy(&length, _read_buffer.data(), sizeof(length_t));
+    size_t record_size = sizeof(length_t) + length;
+    if (record_size > want) {
+      _read_buffer.resize(record_size);
+      bail_unit(_pread_exact(
+        _read_buffer.data() + want, record_size - want, _read_offset + want));
+    }
+    return bee::ok();
+  }
+
+  bee::OrError<> _pread_exact(char* data, size_t size, size_t offset)
+  {
+    size_t done = 0;
+    while (done < size) {
+      ssize_t ret =
+        pread(_fd->int_fd(), data + done, size - done, offset + done);
+      if (ret < 0) {
+        if (errno == EINTR) { continue; }
+        shot("Failed to read from spill file: $", strerror(errno));
+      } else if (ret == 0) {
+        shot("Spill file is shorter than expected");
+      }
+      done += ret;
+    }
+    return bee::ok();
+  }
+
+  // Decodes whole records into _memory, returns the number of bytes consumed
+  size_t _decode_records(const char* data, size_t size)
+  {
+    size_t pos = 0;
+    while (_memory.size() < _high_water && size - pos >= sizeof(length_t)) {
+      length_t length;
+      memcpy(&length, data + pos, sizeof(length_t));
+      if (size - pos - sizeof(length_t) < length) { break; }
+      _memory.push_back(Codec::decode(data + pos + sizeof(length_t), length));
+      pos += sizeof(length_t) + length;
+      _spilled--;
+    }
+    return pos;
+  }
+
+  void _wake()
+  {
+    if (_waiting.empty()) { return; }
+    auto waiting = std::move(_waiting);
+    _waiting.clear();
+    for (auto& ivar : waiting) { ivar->fill(); }
+  }
+
+  size_t _high_water;
+  std::deque<T> _memory;
+
+  bee::FD::shared_ptr _fd;
+  size_t _spilled = 0;
+  size_t _read_offset = 0;
+  size_t _write_offset = 0;
+  std::string _write_buffer;
+  std::string _read_buffer;
+
+  std::vector<Ivar<>::ptr> _waiting;
+
+  bool _closed = false;
+};
+
+} // namespace async
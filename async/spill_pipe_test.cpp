@@ -0,0 +1,66 @@
+#include "spill_pipe.hpp"
+
+#include <string>
+
+#include "testing.hpp"
+
+namespace async {
+namespace {
+
+ASYNC_TEST(spills_in_order)
+{
+  must(pipe, SpillPipe<int>::create(4));
+
+  for (int i = 0; i < 10; i++) { must_unit(pipe->push(i)); }
+  P("size: $ spilled: $", pipe->size(), pipe->spilled());
+
+  // New values keep going to the file until it is drained
+  for (int i = 0; i < 3; i++) {
+    must(value, co_await pipe->next_value());
+    P(*value);
+  }
+  must_unit(pipe->push(10));
+  P("size: $ spilled: $", pipe->size(), pipe->spilled());
+
+  pipe->close();
+  while (true) {
+    must(value, co_await pipe->next_value());
+    if (!value.has_value()) { break; }
+    P(*value);
+  }
+  P("size: $ spilled: $", pipe->size(), pipe->spilled());
+}
+
+ASYNC_TEST(large_records_through_file)
+{
+  must(pipe, SpillPipe<std::string>::create(2));
+
+  auto consumer = [&]() -> Task<> {
+    size_t count = 0;
+    size_t bytes = 0;
+    bool in_order = true;
+    while (true) {
+      must(value, co_await pipe->next_value());
+      if (!value.has_value()) { break; }
+      in_order = in_order && (*value)[0] == 'a' + int(count % 26);
+      bytes += value->size();
+      count++;
+    }
+    P("count: $ bytes: $ in order: $", count, bytes, in_order);
+  };
+  auto task = consumer();
+
+  // Enough data to go through several write and read chunks, with records
+  // bigger than a chunk
+  for (int i = 0; i < 200; i++) {
+    size_t size = i % 50 == 0 ? 100000 : 1000;
+    must_unit(pipe->push(std::string(size, 'a' + i % 26)));
+  }
+  P("spilled: $", pipe->spilled());
+  pipe->close();
+
+  co_await task;
+}
+
+} // namespace
+} // namespace async
@@ -4,9 +4,11 @@
 #include <coroutine>
 #include <optional>
 #include <type_traits>
+#include <vector>
 
 #include "async.hpp"
 #include "deferred_awaitable.hpp"
+#include "trace.hpp"
 
 #include "bee/unit.hpp"
 
@@ -58,11 +60,17 @@ template <deferable_value T> struct TaskState final : public detail::Resumable {
   detail::Resumable::ptr await_resume;
 
   typename Ivar<T>::ptr ivar;
+
+  // Resumed on completion along with the awaiter, see Task::notify_when_done
+  std::vector<detail::Resumable::ptr> observers;
   bool done = false;
 
+  uint64_t trace_id = 0;
+
   virtual void resume() override
   {
     assert(!done);
+    if (trace_id != 0) { Tracer::task_resumed(trace_id); }
     _handle.resume();
   }
 
@@ -103,7 +111,11 @@ template <class P, class T> struct TaskPromiseBase {
 
   TaskPromiseBase()
       : _task_state(make_shared<state_t>(handle_type::from_promise(parent())))
-  {}
+  {
+    if (Tracer::is_enabled()) {
+      _task_state->trace_id = Tracer::task_created();
+    }
+  }
 
   TaskPromiseBase(const TaskPromiseBase& other) = delete;
   TaskPromiseBase(TaskPromiseBase&& other) = delete;
@@ -116,6 +128,9 @@ template <class P, class T> struct TaskPromiseBase {
   std::suspend_never initial_suspend() { return {}; }
   std::suspend_never final_suspend() noexcept
   {
+    if (_task_state->trace_id != 0) {
+      Tracer::task_completed(_task_state->trace_id);
+    }
     _task_state->done = true;
     return {};
   }
@@ -145,6 +160,9 @@ template <class P, class T> struct TaskPromiseBase {
         _task_state->ivar->fill(std::move(*_task_state).value());
       }
     }
+    auto observers = std::move(_task_state->observers);
+    _task_state->observers.clear();
+    for (auto& observer : observers) { observer->resume(); }
     return {};
   }
 
@@ -255,7 +273,11 @@ template <deferable_value T> struct Task {
 
   template <class U> void await_suspend(detail::handle_type<U> h)
   {
-    _task_state->await_resume = h.promise().task_state();
+    const auto& awaiter = h.promise().task_state();
+    if (awaiter->trace_id != 0) {
+      Tracer::task_suspended(awaiter->trace_id, _task_state->trace_id);
+    }
+    _task_state->await_resume = awaiter;
   }
 
   rvalue_type await_resume() { return value(); }
@@ -280,6 +302,15 @@ template <deferable_value T> struct Task {
 
   explicit operator Deferred<value_type>() { return to_deferred(); }
 
+  // Resumes waiter once the task is done, leaving the value in the task. Any
+  // number of waiters can be added, and the task can still be awaited or
+  // turned into a deferred.
+  void notify_when_done(detail::Resumable::ptr waiter)
+  {
+    assert(!done());
+    _task_state->observers.push_back(std::move(waiter));
+  }
+
  private:
   typename state_t::ptr _task_state;
 };
@@ -292,7 +323,10 @@ struct NeverAwaitable {
  public:
   bool await_ready() { return false; }
 
-  template <class U> void await_suspend(std::coroutine_handle<U>) {}
+  template <class U> void await_suspend(std::coroutine_handle<U>)
+  {
+    Tracer::task_suspended(Tracer::current_task());
+  }
 
   void await_resume() {}
 };
@@ -0,0 +1,42 @@
+#include "thread_bridge.hpp"
+
+#include <thread>
+
+#include "testing.hpp"
+
+namespace async {
+namespace {
+
+ASYNC_TEST(thread_to_scheduler)
+{
+  // More values than the channel holds, so the writer has to wait
+  must(bridge, create_thread_bridge_pair<int>(16));
+  auto [reader, writer] = std::move(bridge);
+
+  std::thread producer([writer]() {
+    for (int i = 0; i < 1000; i++) { writer->push(i); }
+    writer->close();
+  });
+
+  int count = 0;
+  long sum = 0;
+  while (auto value = co_await reader->pop()) {
+    count++;
+    sum += *value;
+  }
+  producer.join();
+  P("count: $ sum: $", count, sum);
+}
+
+ASYNC_TEST(reader_closed)
+{
+  must(bridge, create_thread_bridge_pair<int>(16));
+  auto [reader, writer] = std::move(bridge);
+  reader->close();
+  P("push after close: $", writer->push(1));
+  P("writer closed: $", writer->is_closed());
+  co_return;
+}
+
+} // namespace
+} // namespace async
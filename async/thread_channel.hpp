@@ -0,0 +1,295 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <concepts>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "async.hpp"
+#include "deferred_awaitable.hpp"
+#include "task.hpp"
+#include "thread_notifier.hpp"
+
+#include "bee/error.hpp"
+
+namespace async {
+
+// Bounded multi-producer multi-consumer channel for passing values between
+// threads. Values go through a lock-free ring (Vyukov's bounded MPMC queue),
+// so the fast path of push and pop is a couple of atomic operations and no
+// syscalls.
+//
+// Consumers on the scheduler thread use next_value(), other threads use
+// pop_blocking(). A waiting consumer parks by setting a flag, and producers
+// only pay for a wakeup (an eventfd write for the scheduler, a futex wake for
+// threads) when they see that flag set. Producers that find the ring full
+// park the same way until a consumer frees a slot.
+//
+// create() must run on the scheduler thread, everything else can be called
+// from any thread unless noted. The last reference may be dropped on any
+// thread too: the notifier is deregistered from the scheduler thread once the
+// channel is closed.
+template <std::move_constructible T>
+struct ThreadChannel : public std::enable_shared_from_this<ThreadChannel<T>> {
+ public:
+  using ptr = std::shared_ptr<ThreadChannel<T>>;
+
+  ThreadChannel(const ThreadChannel&) = delete;
+  ThreadChannel(ThreadChannel&&) = delete;
+
+  ~ThreadChannel() { close(); }
+
+  // The capacity is rounded up to a power of two
+  static bee::OrError<ptr> create(size_t capacity)
+  {
+    bail(notifier, ThreadNotifier::create());
+    auto channel = ptr(new ThreadChannel(capacity, std::move(notifier)));
+    bail_unit(add_fd(
+      channel->_notifier->read_fd(),
+      [weak = std::weak_ptr<ThreadChannel>(channel),
+       notifier = channel->_notifier]() {
+        auto channel = weak.lock();
+        if (channel != nullptr) { channel->_on_notified(); }
+        // Closing notifies, so this runs on the scheduler thread after close,
+        // even if the channel was destroyed elsewhere. Removing the callback
+        // destroys the captures.
+        if (channel == nullptr || channel->is_closed()) {
+          auto read_fd = notifier->read_fd();
+          remove_fd(read_fd);
+        }
+      }));
+    return channel;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  // Producer side
+  //
+
+  // Returns false if the ring is full or the channel is closed
+  template <std::convertible_to<T> U> bool try_push(U&& value)
+  {
+    if (is_closed()) { return false; }
+    if (!_try_enqueue<U>(value)) { return false; }
+    _wake_consumers();
+    return true;
+  }
+
+  // Blocks the calling thread while the ring is full, returns false if the
+  // channel is closed. Must not be called from the scheduler thread if the
+  // scheduler is the consumer.
+  template <std::convertible_to<T> U> bool push(U&& value)
+  {
+    bool parked = false;
+    while (true) {
+      if (is_closed()) { return false; }
+      if (_try_enqueue<U>(value)) {
+        _wake_consumers();
+        return true;
+      }
+      if (parked) {
+        _producers_parked.wait(true);
+        parked = false;
+      } else {
+        // Retry once after parking, a consumer that popped before it could
+        // see the flag won't wake us
+        _producers_parked.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        parked = true;
+      }
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  // Consumer side
+  //
+
+  std::optional<T> try_pop()
+  {
+    auto value = _try_dequeue();
+    if (value.has_value()) { _wake_producers(); }
+    return value;
+  }
+
+  // Scheduler thread only. Returns nullopt once the channel is closed and
+  // drained.
+  Task<std::optional<T>> next_value()
+  {
+    while (true) {
+      if (auto value = try_pop()) { co_return value; }
+      if (is_closed()) { co_return try_pop(); }
+
+      auto ivar = Ivar<>::create();
+      _waiting.push_back(ivar);
+      _consumer_parked.store(true);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (auto value = try_pop()) {
+        _waiting.pop_back();
+        co_return value;
+      }
+      if (is_closed()) {
+        _waiting.pop_back();
+        continue;
+      }
+      co_await ivar;
+    }
+  }
+
+  // Blocks the calling thread until a value is available. Returns nullopt once
+  // the channel is closed and drained.
+  std::optional<T> pop_blocking()
+  {
+    bool parked = false;
+    while (true) {
+      if (auto value = try_pop()) { return value; }
+      if (is_closed()) { return try_pop(); }
+      if (parked) {
+        _consumer_parked.wait(true);
+        parked = false;
+      } else {
+        _consumer_parked.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        parked = true;
+      }
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  // Both sides
+  //
+
+  // Pushes fail after this, values already in the ring can still be popped
+  void close()
+  {
+    if (_closed.exchange(true)) { return; }
+    _consumer_parked.store(false);
+    _consumer_parked.notify_all();
+    _notifier->notify();
+    _producers_parked.store(false);
+    _producers_parked.notify_all();
+  }
+
+  bool is_closed() const { return _closed.load(std::memory_order_acquire); }
+
+  size_t capacity() const { return _mask + 1; }
+
+ private:
+  // Each slot is on its own cache line so producers and consumers working on
+  // neighbouring slots don't contend
+  struct alignas(64) Cell {
+    std::atomic<size_t> sequence;
+    std::optional<T> value;
+  };
+
+  ThreadChannel(size_t capacity, ThreadNotifier::ptr&& notifier)
+      : _cells(std::bit_ceil(std::max<size_t>(capacity, 2))),
+        _mask(_cells.size() - 1),
+        _notifier(std::move(notifier))
+  {
+    for (size_t i = 0; i < _cells.size(); i++) {
+      _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // Only moves out of value on success
+  template <class U> bool _try_enqueue(std::remove_reference_t<U>& value)
+  {
+    size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &_cells[pos & _mask];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (_enqueue_pos.compare_exchange_weak(
+              pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = _enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value.emplace(std::forward<U>(value));
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  std::optional<T> _try_dequeue()
+  {
+    size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &_cells[pos & _mask];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (_dequeue_pos.compare_exchange_weak(
+              pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return std::nullopt;
+      } else {
+        pos = _dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+    std::optional<T> output(std::move(*cell->value));
+    cell->value.reset();
+    cell->sequence.store(pos + _mask + 1, std::memory_order_release);
+    return output;
+  }
+
+  // The fences pair with the ones taken when parking: either the parked side
+  // sees the new state when it re-checks, or we see its flag here
+  void _wake_consumers()
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (
+      _consumer_parked.load(std::memory_order_relaxed) &&
+      _consumer_parked.exchange(false)) {
+      _notifier->notify();
+      _consumer_parked.notify_all();
+    }
+  }
+
+  void _wake_producers()
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (
+      _producers_parked.load(std::memory_order_relaxed) &&
+      _producers_parked.exchange(false)) {
+      _producers_parked.notify_all();
+    }
+  }
+
+  // Runs on the scheduler thread when the notifier fires
+  void _on_notified()
+  {
+    _notifier->drain();
+    auto waiting = std::move(_waiting);
+    _waiting.clear();
+    for (auto& ivar : waiting) { ivar->fill(); }
+  }
+
+  std::vector<Cell> _cells;
+  const size_t _mask;
+
+  alignas(64) std::atomic<size_t> _enqueue_pos = 0;
+  alignas(64) std::atomic<size_t> _dequeue_pos = 0;
+
+  alignas(64) std::atomic<bool> _consumer_parked = false;
+  std::atomic<bool> _producers_parked = false;
+  std::atomic<bool> _closed = false;
+
+  ThreadNotifier::ptr _notifier;
+
+  // Coroutines on the scheduler thread waiting in next_value()
+  std::vector<Ivar<>::ptr> _waiting;
+};
+
+} // namespace async
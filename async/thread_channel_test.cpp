@@ -0,0 +1,88 @@
+#include "thread_channel.hpp"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "testing.hpp"
+
+namespace async {
+namespace {
+
+ASYNC_TEST(threads_to_scheduler)
+{
+  must(channel, ThreadChannel<int>::create(16));
+  P("capacity: $", channel->capacity());
+
+  constexpr int num_producers = 4;
+  constexpr int per_producer = 10000;
+
+  std::thread closer([channel]() {
+    std::vector<std::thread> producers;
+    for (int p = 0; p < num_producers; p++) {
+      producers.emplace_back([channel]() {
+        for (int i = 1; i <= per_producer; i++) { channel->push(i); }
+      });
+    }
+    for (auto& t : producers) { t.join(); }
+    channel->close();
+  });
+
+  int64_t count = 0;
+  int64_t sum = 0;
+  while (auto value = co_await channel->next_value()) {
+    count++;
+    sum += *value;
+  }
+  closer.join();
+
+  P("count: $", count);
+  P("sum: $", sum);
+  P("push after close: $", channel->try_push(1));
+}
+
+ASYNC_TEST(scheduler_to_thread)
+{
+  must(channel, ThreadChannel<std::string>::create(4));
+
+  std::vector<std::string> received;
+  std::thread consumer([channel, &received]() {
+    while (auto value = channel->pop_blocking()) {
+      received.push_back(std::move(*value));
+    }
+  });
+
+  int pushed = 0;
+  while (pushed < 10) {
+    if (channel->try_push(std::to_string(pushed))) {
+      pushed++;
+    } else {
+      co_await after(bee::Span::of_millis(1));
+    }
+  }
+  channel->close();
+  consumer.join();
+
+  for (const auto& value : received) { P(value); }
+}
+
+ASYNC_TEST(released_on_another_thread)
+{
+  must(channel, ThreadChannel<int>::create(4));
+  std::weak_ptr<ThreadChannel<int>> weak = channel;
+
+  // The thread drops the last reference, the scheduler deregisters the
+  // notifier once it sees the close
+  std::thread producer([channel = std::move(channel)]() mutable {
+    channel->push(1);
+    channel->close();
+    channel = nullptr;
+  });
+  producer.join();
+
+  co_await after(bee::Span::zero());
+  P("released: $", weak.expired());
+}
+
+} // namespace
+} // namespace async
@@ -0,0 +1,70 @@
+#include "thread_notifier.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef __APPLE__
+#include <sys/eventfd.h>
+#endif
+
+using bee::FD;
+
+namespace async {
+
+ThreadNotifier::ThreadNotifier(
+  FD::shared_ptr read_fd, FD::shared_ptr write_fd)
+    : _read_fd(std::move(read_fd)), _write_fd(std::move(write_fd))
+{}
+
+ThreadNotifier::~ThreadNotifier() {}
+
+bee::OrError<ThreadNotifier::ptr> ThreadNotifier::create()
+{
+#ifdef __APPLE__
+  int fds[2];
+  if (::pipe(fds) == -1) {
+    shot("Failed to create notifier pipe: $", strerror(errno));
+  }
+  for (int fd : fds) {
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  }
+  return ptr(new ThreadNotifier(
+    FD(fds[0]).to_shared(), FD(fds[1]).to_shared()));
+#else
+  int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd == -1) { shot("Failed to create eventfd: $", strerror(errno)); }
+  auto shared_fd = FD(fd).to_shared();
+  return ptr(new ThreadNotifier(shared_fd, shared_fd));
+#endif
+}
+
+void ThreadNotifier::notify()
+{
+  // A full pipe or a saturated counter means a wakeup is already pending, so
+  // errors are ignored
+#ifdef __APPLE__
+  char byte = 0;
+  [[maybe_unused]] auto ret = ::write(_write_fd->int_fd(), &byte, 1);
+#else
+  uint64_t one = 1;
+  [[maybe_unused]] auto ret = ::write(_write_fd->int_fd(), &one, sizeof(one));
+#endif
+}
+
+void ThreadNotifier::drain()
+{
+#ifdef __APPLE__
+  char buf[256];
+  while (::read(_read_fd->int_fd(), buf, sizeof(buf)) > 0) {}
+#else
+  uint64_t count;
+  [[maybe_unused]] auto ret = ::read(_read_fd->int_fd(), &count, sizeof(count));
+#endif
+}
+
+} // namespace async
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <memory>
+
+#include "bee/error.hpp"
+#include "bee/fd.hpp"
+
+namespace async {
+
+// Lets other threads wake up the scheduler thread. Backed by an eventfd where
+// available and by a pipe otherwise. Notifications coalesce: any number of
+// notify() calls between two drain() calls makes read_fd readable once.
+struct ThreadNotifier {
+ public:
+  using ptr = std::shared_ptr<ThreadNotifier>;
+
+  ThreadNotifier(const ThreadNotifier&) = delete;
+  ThreadNotifier(ThreadNotifier&&) = delete;
+
+  ~ThreadNotifier();
+
+  static bee::OrError<ptr> create();
+
+  // Safe to call from any thread
+  void notify();
+
+  // Called by the scheduler thread once read_fd is readable
+  void drain();
+
+  const bee::FD::shared_ptr& read_fd() const { return _read_fd; }
+
+ private:
+  ThreadNotifier(bee::FD::shared_ptr read_fd, bee::FD::shared_ptr write_fd);
+
+  bee::FD::shared_ptr _read_fd;
+  bee::FD::shared_ptr _write_fd;
+};
+
+} // namespace async
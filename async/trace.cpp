@@ -0,0 +1,270 @@
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+
+#include "bee/fd.hpp"
+
+using std::string;
+using std::vector;
+
+namespace async {
+namespace {
+
+struct TraceState {
+ public:
+  void reset(size_t capacity)
+  {
+    _ring.clear();
+    _ring.resize(std::max<size_t>(capacity, 1));
+    _next = 0;
+    _count = 0;
+    _running.clear();
+    _origin_ns = now_ns();
+  }
+
+  void record(TraceEventKind kind, uint64_t task_id, uint64_t other_id)
+  {
+    _ring[_next] = TraceEvent{
+      .kind = kind,
+      .timestamp_ns = now_ns() - _origin_ns,
+      .task_id = task_id,
+      .other_id = other_id,
+    };
+    _next = (_next + 1) % _ring.size();
+    _count = std::min(_count + 1, _ring.size());
+  }
+
+  vector<TraceEvent> events() const
+  {
+    vector<TraceEvent> output;
+    if (_ring.empty()) { return output; }
+    output.reserve(_count);
+    size_t first = (_next + _ring.size() - _count) % _ring.size();
+    for (size_t i = 0; i < _count; i++) {
+      output.push_back(_ring[(first + i) % _ring.size()]);
+    }
+    return output;
+  }
+
+  uint64_t next_task_id() { return _next_task_id++; }
+
+  void push_running(uint64_t task_id) { _running.push_back(task_id); }
+
+  // Awaitables that don't report suspensions can leave stale entries behind,
+  // so drop everything above the task that stopped running.
+  void pop_running(uint64_t task_id)
+  {
+    auto it = std::find(_running.rbegin(), _running.rend(), task_id);
+    if (it == _running.rend()) { return; }
+    _running.erase(std::next(it).base(), _running.end());
+  }
+
+  uint64_t current_task() const
+  {
+    return _running.empty() ? 0 : _running.back();
+  }
+
+ private:
+  static int64_t now_ns()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+  }
+
+  vector<TraceEvent> _ring;
+  size_t _next = 0;
+  size_t _count = 0;
+
+  vector<uint64_t> _running;
+  uint64_t _next_task_id = 1;
+  int64_t _origin_ns = 0;
+};
+
+TraceState& state()
+{
+  static TraceState state;
+  return state;
+}
+
+void append_event(
+  string& out,
+  const char* name,
+  uint64_t name_id,
+  const char* phase,
+  int64_t ts_ns,
+  uint64_t tid,
+  const char* extra)
+{
+  char buf[256];
+  snprintf(
+    buf,
+    sizeof(buf),
+    "{\"name\":\"%s%s\",\"cat\":\"async\",\"ph\":\"%s\",\"ts\":%lld.%03lld,"
+    "\"pid\":1,\"tid\":%llu%s}",
+    name,
+    name_id == 0 ? "" : std::to_string(name_id).c_str(),
+    phase,
+    (long long)(ts_ns / 1000),
+    (long long)(ts_ns % 1000),
+    (unsigned long long)tid,
+    extra);
+  if (out.back() != '[') { out += ",\n"; }
+  out += buf;
+}
+
+} // namespace
+
+void Tracer::start(size_t capacity)
+{
+  state().reset(capacity);
+  enabled_flag() = true;
+}
+
+void Tracer::stop() { enabled_flag() = false; }
+
+vector<TraceEvent> Tracer::events() { return state().events(); }
+
+uint64_t Tracer::task_created()
+{
+  if (!is_enabled()) { return 0; }
+  auto& s = state();
+  uint64_t task_id = s.next_task_id();
+  s.record(TraceEventKind::TaskCreated, task_id, s.current_task());
+  s.push_running(task_id);
+  return task_id;
+}
+
+void Tracer::task_suspended(uint64_t task_id, uint64_t awaiting_id)
+{
+  if (!is_enabled() || task_id == 0) { return; }
+  auto& s = state();
+  s.record(TraceEventKind::TaskSuspended, task_id, awaiting_id);
+  s.pop_running(task_id);
+}
+
+void Tracer::task_resumed(uint64_t task_id)
+{
+  if (!is_enabled() || task_id == 0) { return; }
+  auto& s = state();
+  s.record(TraceEventKind::TaskResumed, task_id, 0);
+  s.push_running(task_id);
+}
+
+void Tracer::task_completed(uint64_t task_id)
+{
+  if (!is_enabled() || task_id == 0) { return; }
+  auto& s = state();
+  s.record(TraceEventKind::TaskCompleted, task_id, 0);
+  s.pop_running(task_id);
+}
+
+void Tracer::callback_begin()
+{
+  if (!is_enabled()) { return; }
+  state().record(TraceEventKind::CallbackBegin, 0, 0);
+}
+
+void Tracer::callback_end()
+{
+  if (!is_enabled()) { return; }
+  state().record(TraceEventKind::CallbackEnd, 0, 0);
+}
+
+uint64_t Tracer::current_task()
+{
+  if (!is_enabled()) { return 0; }
+  return state().current_task();
+}
+
+string Tracer::to_chrome_trace_json()
+{
+  // Each task gets its own track, running slices are B/E pairs and
+  // parent/child links are flow events
+  string out = "{\"traceEvents\":[";
+  for (const auto& ev : events()) {
+    char extra[96];
+    switch (ev.kind) {
+    case TraceEventKind::TaskCreated:
+      if (ev.other_id != 0) {
+        snprintf(
+          extra,
+          sizeof(extra),
+          ",\"id\":%llu",
+          (unsigned long long)ev.task_id);
+        append_event(
+          out, "spawn", 0, "s", ev.timestamp_ns, ev.other_id, extra);
+        snprintf(
+          extra,
+          sizeof(extra),
+          ",\"id\":%llu,\"bp\":\"e\"",
+          (unsigned long long)ev.task_id);
+        append_event(out, "spawn", 0, "f", ev.timestamp_ns, ev.task_id, extra);
+      }
+      append_event(
+        out, "task ", ev.task_id, "B", ev.timestamp_ns, ev.task_id, "");
+      break;
+    case TraceEventKind::TaskResumed:
+      append_event(
+        out, "task ", ev.task_id, "B", ev.timestamp_ns, ev.task_id, "");
+      break;
+    case TraceEventKind::TaskSuspended:
+      extra[0] = 0;
+      if (ev.other_id != 0) {
+        snprintf(
+          extra,
+          sizeof(extra),
+          ",\"args\":{\"awaiting\":%llu}",
+          (unsigned long long)ev.other_id);
+      }
+      append_event(
+        out, "task ", ev.task_id, "E", ev.timestamp_ns, ev.task_id, extra);
+      break;
+    case TraceEventKind::TaskCompleted:
+      append_event(
+        out,
+        "task ",
+        ev.task_id,
+        "E",
+        ev.timestamp_ns,
+        ev.task_id,
+        ",\"args\":{\"completed\":true}");
+      break;
+    case TraceEventKind::CallbackBegin:
+      append_event(out, "callback", 0, "B", ev.timestamp_ns, 0, "");
+      break;
+    case TraceEventKind::CallbackEnd:
+      append_event(out, "callback", 0, "E", ev.timestamp_ns, 0, "");
+      break;
+    }
+  }
+  out += "]}\n";
+  return out;
+}
+
+bee::OrError<> Tracer::write_chrome_trace(const string& path)
+{
+  int int_fd =
+    ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (int_fd == -1) {
+    shot("Failed to open trace file '$': $", path, strerror(errno));
+  }
+  bee::FD fd(int_fd);
+  auto json = to_chrome_trace_json();
+  auto data = reinterpret_cast<const std::byte*>(json.data());
+  size_t done = 0;
+  while (done < json.size()) {
+    bail(written, fd.write(data + done, json.size() - done));
+    done += written;
+  }
+  if (!fd.close()) { shot("Failed to close trace file '$'", path); }
+  return bee::ok();
+}
+
+} // namespace async
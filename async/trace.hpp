@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bee/error.hpp"
+
+namespace async {
+
+enum class TraceEventKind {
+  TaskCreated,
+  TaskSuspended,
+  TaskResumed,
+  TaskCompleted,
+  CallbackBegin,
+  CallbackEnd,
+};
+
+struct TraceEvent {
+  TraceEventKind kind;
+  int64_t timestamp_ns;
+
+  // Zero for scheduler callbacks
+  uint64_t task_id;
+
+  // For TaskCreated, the task that was running when this one was created. For
+  // TaskSuspended, the task being awaited, if known.
+  uint64_t other_id;
+};
+
+// Opt-in recorder of task lifecycle and scheduler callback events. Events are
+// kept in a fixed size ring buffer, so only the most recent ones survive.
+// Like the scheduler, it must only be used from the scheduler thread.
+struct Tracer {
+ public:
+  static void start(size_t capacity = 1 << 16);
+  static void stop();
+
+  static bool is_enabled() { return enabled_flag(); }
+
+  static std::vector<TraceEvent> events();
+
+  // Chrome trace-event format, can be loaded in chrome://tracing or Perfetto
+  static std::string to_chrome_trace_json();
+  static bee::OrError<> write_chrome_trace(const std::string& path);
+
+  // Hooks called by Task and the schedulers, ids of zero are ignored
+  static uint64_t task_created();
+  static void task_suspended(uint64_t task_id, uint64_t awaiting_id = 0);
+  static void task_resumed(uint64_t task_id);
+  static void task_completed(uint64_t task_id);
+
+  static void callback_begin();
+  static void callback_end();
+
+  static uint64_t current_task();
+
+ private:
+  static bool& enabled_flag()
+  {
+    static bool enabled = false;
+    return enabled;
+  }
+};
+
+} // namespace async
@@ -0,0 +1,111 @@
+#include <fstream>
+#include <sstream>
+
+#include <unistd.h>
+
+#include "deferred_awaitable.hpp"
+#include "task.hpp"
+#include "testing.hpp"
+#include "trace.hpp"
+
+using bee::Span;
+using std::string;
+
+namespace async {
+namespace {
+
+const char* kind_name(TraceEventKind kind)
+{
+  switch (kind) {
+  case TraceEventKind::TaskCreated:
+    return "created";
+  case TraceEventKind::TaskSuspended:
+    return "suspended";
+  case TraceEventKind::TaskResumed:
+    return "resumed";
+  case TraceEventKind::TaskCompleted:
+    return "completed";
+  case TraceEventKind::CallbackBegin:
+    return "callback_begin";
+  case TraceEventKind::CallbackEnd:
+    return "callback_end";
+  }
+  return "unknown";
+}
+
+Task<int> child()
+{
+  co_await after(Span::of_millis(10));
+  co_return 42;
+}
+
+Task<int> parent()
+{
+  auto value = co_await child();
+  co_return value + 1;
+}
+
+ASYNC_TEST(task_events)
+{
+  Tracer::start();
+  auto value = co_await parent();
+  Tracer::stop();
+
+  P("value: $", value);
+  for (const auto& ev : Tracer::events()) {
+    if (ev.task_id == 0) { continue; }
+    P("$ task:$ other:$", kind_name(ev.kind), ev.task_id, ev.other_id);
+  }
+}
+
+ASYNC_TEST(ring_buffer_keeps_latest)
+{
+  Tracer::start(4);
+  for (int i = 0; i < 3; i++) { co_await parent(); }
+  Tracer::stop();
+
+  P("events: $", Tracer::events().size());
+}
+
+ASYNC_TEST(chrome_json)
+{
+  Tracer::start();
+  co_await parent();
+  Tracer::stop();
+
+  auto json = Tracer::to_chrome_trace_json();
+  auto count = [&](const string& needle) {
+    int n = 0;
+    for (size_t pos = json.find(needle); pos != string::npos;
+         pos = json.find(needle, pos + 1)) {
+      n++;
+    }
+    return n;
+  };
+  P("prefix: $", json.substr(0, 15));
+  P("task slices: $", count("{\"name\":\"task "));
+  P("flows: $", count("\"ph\":\"s\""));
+  P("awaits: $", count("\"awaiting\":"));
+  P("suffix: $", json.substr(json.size() - 3, 2));
+}
+
+ASYNC_TEST(write_chrome_trace)
+{
+  Tracer::start();
+  co_await parent();
+  Tracer::stop();
+
+  auto path = F("/tmp/trace_test_$.json", getpid());
+  must_unit(Tracer::write_chrome_trace(path));
+  std::ifstream file(path);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  unlink(path.c_str());
+  P("matches: $", contents.str() == Tracer::to_chrome_trace_json());
+
+  P("bad path: $",
+    Tracer::write_chrome_trace("/nonexistent/trace.json").is_error());
+}
+
+} // namespace
+} // namespace async